@@ -0,0 +1,372 @@
+#pragma once
+
+#ifndef IMAGE_TEMPLATE_H
+#define IMAGE_TEMPLATE_H
+
+#include "Image3x8.h"
+#include "parallel.h"
+#include "resample.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numbers>
+#include <type_traits>
+#include <vector>
+
+template <typename Sample, int32_t Channels>
+struct PixelOf {
+    using SampleType = Sample;
+    static constexpr int32_t s_channels = Channels;
+    static constexpr int32_t s_depth = static_cast<int32_t>(8 * sizeof(Sample));
+
+    Sample samples[Channels];
+};
+
+using PixelRGB8 = PixelOf<uint8_t, 3>;
+using PixelRGBA8 = PixelOf<uint8_t, 4>;
+using PixelRGB16 = PixelOf<uint16_t, 3>;
+using PixelRGBF32 = PixelOf<float, 3>;
+using PixelRGBAF32 = PixelOf<float, 4>;
+
+// Full scale of a sample: 255 or 65535 for the integer formats, 1 for float.
+template <typename Sample>
+constexpr float sample_max()
+{
+    if constexpr (std::is_floating_point_v<Sample>)
+        return 1.0f;
+    else
+        return static_cast<float>(std::numeric_limits<Sample>::max());
+}
+
+// Rounds and clamps integer formats; float samples are kept as they are, out of range values included.
+template <typename Sample>
+Sample to_sample(const float value)
+{
+    if constexpr (std::is_floating_point_v<Sample>)
+        return value;
+    else
+        return static_cast<Sample>(std::clamp(value + 0.5f, 0.0f, sample_max<Sample>()));
+}
+
+template <typename To, typename From>
+To convert_sample(const From value)
+{
+    if constexpr (std::is_same_v<To, From>)
+        return value;
+    else if constexpr (std::is_same_v<From, uint8_t> && std::is_same_v<To, uint16_t>)
+        return static_cast<uint16_t>(value * 257);
+    else
+        return to_sample<To>(static_cast<float>(value) * (sample_max<To>() / sample_max<From>()));
+}
+
+// How separable_filter treats taps that fall outside the image: Replicate repeats the edge sample, InBounds leaves
+// them out and divides by the weight of the taps that are left.
+enum class FilterEdges : uint8_t {
+    Replicate,
+    InBounds
+};
+
+// Image over any PixelOf format. Samples are interleaved, so every kernel is a loop over `s_channels * width`
+// contiguous samples specialized for the sample type at compile time. A float image is the working space for
+// multi-stage pipelines: convert once, run the stages, quantize once at the end.
+template <typename PixelT>
+class Image {
+public:
+    using PixelType = PixelT;
+    using Sample = typename PixelT::SampleType;
+    static constexpr int32_t s_channels = PixelT::s_channels;
+    static constexpr int32_t s_depth = PixelT::s_depth;
+
+private:
+    static_assert(sizeof(PixelT) == sizeof(Sample) * s_channels, "pixels must be packed samples");
+
+    int32_t m_height;
+    int32_t m_width;
+    std::vector<PixelT> m_pixels;
+
+public:
+    // CREATORS
+    Image()
+        : m_height(0), m_width(0)
+    {
+    }
+
+    Image(const int32_t height, const int32_t width)
+        : m_height(height), m_width(width), m_pixels(static_cast<size_t>(height) * width)
+    {
+    }
+
+    explicit Image(const Image3x8& image);
+
+    template <typename OtherT>
+    explicit Image(const Image<OtherT>& other);
+
+    // MANIPULATORS
+    PixelT* operator[](const int32_t row) { return m_pixels.data() + static_cast<size_t>(m_width) * row; }
+    Sample* samples() { return reinterpret_cast<Sample*>(m_pixels.data()); }
+    void blur();
+    void gaussian_blur(double std_deviation);
+    void resize(int32_t new_height, int32_t new_width, ResizeFilter filter);
+
+    // ACCESSORS
+    [[nodiscard]] Image3x8 to_image3x8() const;
+    [[nodiscard]] int32_t height() const { return m_height; }
+    [[nodiscard]] int32_t width() const { return m_width; }
+    [[nodiscard]] size_t size() const { return m_pixels.size(); }
+    [[nodiscard]] const Sample* samples() const { return reinterpret_cast<const Sample*>(m_pixels.data()); }
+    [[nodiscard]] const PixelT* operator[](const int32_t row) const
+    {
+        return m_pixels.data() + static_cast<size_t>(m_width) * row;
+    }
+private:
+    void separable_filter(const std::vector<float>& kernel, FilterEdges edges);
+};
+
+// Copies the channels both formats have; a channel only the target has (alpha) is set to full scale.
+template <typename To, typename From, int32_t ToChannels, int32_t FromChannels>
+void convert_samples(const From* src, To* dst, const size_t pixel_count)
+{
+    for (size_t i = 0; i < pixel_count; ++i)
+        for (int32_t channel = 0; channel < ToChannels; ++channel)
+            dst[i * ToChannels + channel] = channel < FromChannels
+                ? convert_sample<To>(src[i * FromChannels + channel])
+                : to_sample<To>(sample_max<To>());
+}
+
+template <typename PixelT>
+Image<PixelT>::Image(const Image3x8& image)
+    : Image(image.height(), image.width())
+{
+    convert_samples<Sample, uint8_t, s_channels, 3>(reinterpret_cast<const uint8_t*>(image[0]), samples(), size());
+}
+
+template <typename PixelT>
+template <typename OtherT>
+Image<PixelT>::Image(const Image<OtherT>& other)
+    : Image(other.height(), other.width())
+{
+    convert_samples<Sample, typename OtherT::SampleType, s_channels, OtherT::s_channels>(other.samples(),
+        samples(), size());
+}
+
+template <typename PixelT>
+Image3x8 Image<PixelT>::to_image3x8() const
+{
+    static_assert(3 <= s_channels, "Image3x8 needs red, green and blue");
+    Image3x8 result(m_height, m_width);
+    convert_samples<uint8_t, Sample, 3, s_channels>(samples(), reinterpret_cast<uint8_t*>(result[0]), size());
+    return result;
+}
+
+// Correlates the rows and then the columns of interleaved samples with an odd length kernel. `load` turns a sample
+// into the float it is filtered as and `store` the other way round, so a transfer function can ride along with the
+// first and last pass. The horizontal pass is kept in float, so integer formats are only rounded once. Bands of rows
+// run on their own threads, each with a ring of the last `taps` horizontally filtered rows.
+template <typename Sample, int32_t Channels, typename Load, typename Store>
+void separable_filter(Sample* pixels, const int32_t height, const int32_t width, const std::vector<float>& kernel,
+    const FilterEdges edges, Load&& load, Store&& store)
+{
+    if (height == 0 || width == 0)
+        return;
+    const auto taps = static_cast<int32_t>(kernel.size());
+    const int32_t anchor = taps / 2;
+    const size_t length = static_cast<size_t>(width) * Channels;
+    const bool in_bounds = edges == FilterEdges::InBounds;
+    auto inside_weight = [&](const int32_t position, const int32_t size) {
+        float sum = 0.0f;
+        for (int32_t tap = 0; tap < taps; ++tap)
+            if (0 <= position - anchor + tap && position - anchor + tap < size)
+                sum += kernel[tap];
+        return sum;
+    };
+    auto filter_row = [&](const Sample* src, float* dst, std::vector<float>& padded) {
+        for (int32_t col = 0; col < width + taps - 1; ++col) {
+            const bool inside = anchor <= col && col < width + anchor;
+            const Sample* pixel = src + std::clamp(col - anchor, 0, width - 1) * Channels;
+            for (int32_t channel = 0; channel < Channels; ++channel)
+                padded[col * Channels + channel] = inside || !in_bounds ? load(pixel[channel]) : 0.0f;
+        }
+        std::fill(dst, dst + length, 0.0f);
+        for (int32_t tap = 0; tap < taps; ++tap) {
+            const float weight = kernel[tap];
+            const float* shifted = padded.data() + tap * Channels;
+            for (size_t i = 0; i < length; ++i)
+                dst[i] += weight * shifted[i];
+        }
+        if (in_bounds)
+            for (int32_t col = 0; col < width; ++col)
+                if (col < anchor || width - anchor <= col) {
+                    const float weight = inside_weight(col, width);
+                    for (int32_t channel = 0; channel < Channels; ++channel)
+                        dst[col * Channels + channel] /= weight;
+                }
+    };
+    const int32_t bands = std::clamp(height / std::max(4 * anchor, 16), 1, thread_count());
+    // Rows next to a band are overwritten by the neighbouring band, so keep their originals per band:
+    // `anchor` rows above followed by `anchor` rows below.
+    std::vector<std::vector<Sample> > halos(bands);
+    for (int32_t band = 0; band < bands; ++band) {
+        const int32_t begin = height * band / bands;
+        const int32_t end = height * (band + 1) / bands;
+        std::vector<Sample>& halo = halos[band];
+        halo.resize(2 * anchor * length);
+        for (int32_t i = 0; i < anchor; ++i) {
+            std::copy_n(pixels + std::clamp(begin - anchor + i, 0, height - 1) * length, length,
+                halo.data() + i * length);
+            std::copy_n(pixels + std::clamp(end + i, 0, height - 1) * length, length,
+                halo.data() + (anchor + i) * length);
+        }
+    }
+    parallel_bands(bands, [&](const int32_t first, const int32_t last) {
+        std::vector<float> ring(static_cast<size_t>(taps) * length);
+        std::vector<float> padded((width + taps - 1) * Channels);
+        std::vector<float> sum(length);
+        auto slot = [&](const int32_t row) {
+            return &ring[static_cast<size_t>((row % taps + taps) % taps) * length];
+        };
+        for (int32_t band = first; band < last; ++band) {
+            const int32_t begin = height * band / bands;
+            const int32_t end = height * (band + 1) / bands;
+            const Sample* halo = halos[band].data();
+            auto source_row = [&](const int32_t row) -> const Sample* {
+                if (row < begin)
+                    return halo + (row - begin + anchor) * length;
+                if (end <= row)
+                    return halo + (row - end + anchor) * length;
+                return pixels + row * length;
+            };
+            for (int32_t row = begin - anchor; row < begin + anchor; ++row)
+                filter_row(source_row(row), slot(row), padded);
+            for (int32_t row = begin; row < end; ++row) {
+                filter_row(source_row(row + anchor), slot(row + anchor), padded);
+                std::fill(sum.begin(), sum.end(), 0.0f);
+                for (int32_t tap = 0; tap < taps; ++tap) {
+                    const int32_t source = row - anchor + tap;
+                    if (in_bounds && (source < 0 || height <= source))
+                        continue;
+                    const float weight = kernel[tap];
+                    const float* src = slot(source);
+                    for (size_t i = 0; i < length; ++i)
+                        sum[i] += weight * src[i];
+                }
+                const float scale = in_bounds && (row < anchor || height - anchor <= row)
+                    ? 1.0f / inside_weight(row, height) : 1.0f;
+                Sample* dst = pixels + row * length;
+                for (size_t i = 0; i < length; ++i)
+                    dst[i] = store(sum[i] * scale);
+            }
+        }
+    }, 1);
+}
+
+// Resamples interleaved samples with float weights, with the same `load` and `store` as separable_filter. Each band
+// of output rows keeps a ring of the `taps` source rows under the vertical filter, resampled horizontally.
+template <typename Sample, int32_t Channels, typename Load, typename Store>
+void resample_float(const Sample* pixels, const int32_t height, const int32_t width, Sample* output,
+    const int32_t new_height, const int32_t new_width, const ResizeFilter filter, Load&& load, Store&& store)
+{
+    const ResampleWeightsFloat weights_x = make_resample_weights_float(width, new_width, filter);
+    const ResampleWeightsFloat weights_y = make_resample_weights_float(height, new_height, filter);
+    const size_t src_length = static_cast<size_t>(width) * Channels;
+    const size_t length = static_cast<size_t>(new_width) * Channels;
+    const int32_t taps = weights_y.taps;
+    parallel_bands(new_height, [&](const int32_t begin, const int32_t end) {
+        std::vector<float> line(src_length);
+        std::vector<float> ring(static_cast<size_t>(taps) * length);
+        std::vector<float> sum(length);
+        auto slot = [&](const int32_t row) { return &ring[static_cast<size_t>(row % taps) * length]; };
+        // Starts never decrease, so the rows from `next - taps` on are still in the ring.
+        int32_t next = 0;
+        for (int32_t row = begin; row < end; ++row) {
+            const int32_t start = weights_y.start[row];
+            for (int32_t source = std::max(next, start); source < start + taps; ++source) {
+                const Sample* src = pixels + source * src_length;
+                for (size_t i = 0; i < src_length; ++i)
+                    line[i] = load(src[i]);
+                float* dst = slot(source);
+                for (int32_t col = 0; col < new_width; ++col) {
+                    const float* first = line.data() + weights_x.start[col] * Channels;
+                    const float* weight = &weights_x.weights[static_cast<size_t>(col) * weights_x.taps];
+                    float pixel[Channels] = {};
+                    for (int32_t k = 0; k < weights_x.taps; ++k)
+                        for (int32_t channel = 0; channel < Channels; ++channel)
+                            pixel[channel] += weight[k] * first[k * Channels + channel];
+                    std::copy_n(pixel, Channels, dst + col * Channels);
+                }
+            }
+            next = start + taps;
+            std::fill(sum.begin(), sum.end(), 0.0f);
+            const float* weight = &weights_y.weights[static_cast<size_t>(row) * taps];
+            for (int32_t k = 0; k < taps; ++k) {
+                const float* src = slot(start + k);
+                for (size_t i = 0; i < length; ++i)
+                    sum[i] += weight[k] * src[i];
+            }
+            Sample* dst = output + row * length;
+            for (size_t i = 0; i < length; ++i)
+                dst[i] = store(sum[i]);
+        }
+    });
+}
+
+// The 1D factor of make_gauss_kernel: the same reach from get_distance and the same unnormalized weights, so the
+// rows and columns passes together apply the kernel Image3x8::gaussian_blur does.
+inline std::vector<float> make_separable_gauss_kernel(const double std_deviation)
+{
+    const int32_t distance = get_distance(std_deviation);
+    const double constant = 2.0 * std_deviation * std_deviation;
+    const double scale = 1.0 / std::sqrt(constant * std::numbers::pi);
+    std::vector<float> kernel(distance * 2 + 1);
+    for (int32_t x = -distance; x <= distance; ++x)
+        kernel[x + distance] = static_cast<float>(std::exp(-(x * x) / constant) * scale);
+    return kernel;
+}
+
+template <typename PixelT>
+void Image<PixelT>::separable_filter(const std::vector<float>& kernel, const FilterEdges edges)
+{
+    ::separable_filter<Sample, s_channels>(samples(), m_height, m_width, kernel, edges,
+        [](const Sample value) { return static_cast<float>(value); },
+        [](const float value) { return to_sample<Sample>(value); });
+}
+
+// Each pixel becomes the mean of the pixels of its 3x3 neighbourhood inside the image, as in Image3x8::blur, and
+// integer formats truncate it the same way. A mean of up to 9 samples is at least 1/9 below the next integer and
+// the float sums stay within 1/16 of it even at 16 bits, so truncating after adding 1/16 gives the exact floor.
+template <typename PixelT>
+void Image<PixelT>::blur()
+{
+    ::separable_filter<Sample, s_channels>(samples(), m_height, m_width, { 1.0f / 3, 1.0f / 3, 1.0f / 3 },
+        FilterEdges::InBounds, [](const Sample value) { return static_cast<float>(value); },
+        [](const float value) {
+            if constexpr (std::is_floating_point_v<Sample>)
+                return value;
+            else
+                return static_cast<Sample>(std::clamp(value + 1.0f / 16, 0.0f, sample_max<Sample>()));
+        });
+}
+
+// The kernel and edge replication of Image3x8::gaussian_blur.
+template <typename PixelT>
+void Image<PixelT>::gaussian_blur(const double std_deviation)
+{
+    if (std_deviation <= 0.0 || m_height == 0 || m_width == 0)
+        return;
+    separable_filter(make_separable_gauss_kernel(std_deviation), FilterEdges::Replicate);
+}
+
+template <typename PixelT>
+void Image<PixelT>::resize(const int32_t new_height, const int32_t new_width, const ResizeFilter filter)
+{
+    assert(0 < new_height && 0 < new_width && "resize to an empty image");
+    Image result(new_height, new_width);
+    resample_float<Sample, s_channels>(samples(), m_height, m_width, result.samples(), new_height, new_width, filter,
+        [](const Sample value) { return static_cast<float>(value); },
+        [](const float value) { return to_sample<Sample>(value); });
+    *this = std::move(result);
+}
+
+#endif //IMAGE_TEMPLATE_H
@@ -1,7 +1,15 @@
 #include "Image3x8.h"
 
+#include "ImageGray8.h"
+#include "bilateral.h"
+#include "color.h"
+#include "convolve.h"
+#include "median.h"
+#include "unsharp.h"
+
+#include <algorithm>
+#include <array>
 #include <cmath>
-#include <cstring>
 #include <iostream>
 #include <cassert>
 #include <numbers>
@@ -119,6 +127,9 @@ Image3x8& Image3x8::operator=(const Image3x8& other)
 
 Image3x8& Image3x8::operator=(Image3x8&& other) noexcept
 {
+    if (this == &other)
+        return *this;
+    delete[] m_pixels;
     this->m_height = other.m_height;
     this->m_width = other.m_width;
     this->m_pixels = other.m_pixels;
@@ -145,25 +156,21 @@ void Image3x8::black_out_part(const int32_t start_row,
 
 void Image3x8::grey_scale()
 {
-    for (size_t i = 0; i < size(); ++i) {
-        double temp = m_pixels[i].red;
-        temp += m_pixels[i].green * 0.7152;
-        temp += m_pixels[i].blue;
-        temp = (temp + 0.5) / 3;
-        clamp(temp, 0, 255);
-        memset(reinterpret_cast<void*>(&m_pixels[i]), static_cast<uint8_t>(temp), 3);
+    std::vector<uint8_t> grey(m_width);
+    for (int32_t row = 0; row < m_height; ++row) {
+        auto* pixels = reinterpret_cast<uint8_t*>((*this)[row]);
+        rgb_to_grey(pixels, grey.data(), m_width);
+        grey_to_rgb(grey.data(), pixels, m_width);
     }
 }
 
 void Image3x8::grey_scale_lum()
 {
-    for (size_t i = 0; i < size(); ++i) {
-        double temp = m_pixels[i].red * 0.2126;
-        temp += m_pixels[i].green * 0.7152;
-        temp += m_pixels[i].blue * 0.0722;
-        temp = (temp + 0.5) / 3;
-        clamp(temp, 0, 255);
-        memset(reinterpret_cast<void*>(&m_pixels[i]), static_cast<uint8_t>(temp), 3);
+    std::vector<uint8_t> grey(m_width);
+    for (int32_t row = 0; row < m_height; ++row) {
+        auto* pixels = reinterpret_cast<uint8_t*>((*this)[row]);
+        rgb_to_grey_lum(pixels, grey.data(), m_width);
+        grey_to_rgb(grey.data(), pixels, m_width);
     }
 }
 
@@ -182,6 +189,53 @@ void Image3x8::color_mask(const double red, const double green, const double blu
     }
 }
 
+void Image3x8::apply_lut(const Lut& red, const Lut& green, const Lut& blue)
+{
+    const Lut luts[3] = { red, green, blue };
+    apply_luts(reinterpret_cast<uint8_t*>(m_pixels), size(), 3, luts);
+}
+
+void Image3x8::equalize()
+{
+    const std::array<ChannelHistogram, 3> histograms = histogram();
+    apply_lut(make_equalize_lut(histograms[0]), make_equalize_lut(histograms[1]), make_equalize_lut(histograms[2]));
+}
+
+void Image3x8::auto_levels(const double clip_fraction)
+{
+    const std::array<ChannelHistogram, 3> histograms = histogram();
+    apply_lut(make_levels_lut(histograms[0], clip_fraction),
+        make_levels_lut(histograms[1], clip_fraction),
+        make_levels_lut(histograms[2], clip_fraction));
+}
+
+std::array<ChannelHistogram, 3> Image3x8::histogram() const
+{
+    std::array<ChannelHistogram, 3> result;
+    build_histograms(reinterpret_cast<const uint8_t*>(m_pixels), size(), 3, result.data());
+    return result;
+}
+
+std::array<ChannelStatistics, 3> Image3x8::statistics() const
+{
+    const std::array<ChannelHistogram, 3> histograms = histogram();
+    return { ChannelStatistics(histograms[0]), ChannelStatistics(histograms[1]), ChannelStatistics(histograms[2]) };
+}
+
+ImageGray8 Image3x8::to_grey_scale() const
+{
+    ImageGray8 result(m_height, m_width);
+    rgb_to_grey(reinterpret_cast<const uint8_t*>(m_pixels), result[0], size());
+    return result;
+}
+
+ImageGray8 Image3x8::to_grey_scale_lum() const
+{
+    ImageGray8 result(m_height, m_width);
+    rgb_to_grey_lum(reinterpret_cast<const uint8_t*>(m_pixels), result[0], size());
+    return result;
+}
+
 std::vector<uint8_t> Image3x8::get_data() const
 {
     std::vector<uint8_t> result(m_height * m_width * 3);
@@ -230,65 +284,217 @@ void Image3x8::reflect_vertical()
         }
 }
 
-void Image3x8::blur()
+// Calls function(row, rows) with the original rows above, at and below `row` (nullptr outside the image) while
+// `row` is rewritten in place. Only the current and previous rows need saving, the next row is still untouched.
+template <typename Function>
+void Image3x8::for_each_row_3x3(Function&& function)
+{
+    std::vector<Pixel> ring(2 * static_cast<size_t>(m_width));
+    Pixel* previous = ring.data();
+    Pixel* current = ring.data() + m_width;
+    for (int32_t row = 0; row < m_height; ++row) {
+        std::copy_n((*this)[row], m_width, current);
+        const Pixel* rows[3] = { row == 0 ? nullptr : previous, current,
+            row + 1 == m_height ? nullptr : (*this)[row + 1] };
+        function(row, rows);
+        std::swap(previous, current);
+    }
+}
+
+// sRGB codes decoded to linear light on a 16 bit scale, for the linear light blurs. Their results are rounded to
+// 16 bits and encoded a row at a time.
+static const std::array<double, 256>& linear16_values()
+{
+    static const std::array<double, 256> values = [] {
+        std::array<uint8_t, 256> codes{};
+        std::array<uint16_t, 256> linear{};
+        for (int32_t code = 0; code < 256; ++code)
+            codes[code] = static_cast<uint8_t>(code);
+        srgb_to_linear16(codes.data(), linear.data(), 256);
+        std::array<double, 256> result{};
+        std::copy(linear.begin(), linear.end(), result.begin());
+        return result;
+    }();
+    return values;
+}
+
+static uint16_t round_linear16(const double value)
+{
+    return static_cast<uint16_t>(std::clamp(value, 0.0, 65535.0) + 0.5);
+}
+
+static void store_linear16(const PixelDouble& color, uint16_t* linear)
+{
+    linear[0] = round_linear16(color.red);
+    linear[1] = round_linear16(color.green);
+    linear[2] = round_linear16(color.blue);
+}
+
+void Image3x8::blur(const bool linear_light)
 {
-    const Image3x8 copy(*this);
     PixelDouble color;
     const std::vector<int8_t> kernel = { 1, 1, 1, 1, 1, 1, 1, 1, 1 };
-    for (int32_t row = 0; row < m_height; ++row)
+    if (!linear_light) {
+        for_each_row_3x3([&](const int32_t row, const Pixel* const* rows) {
+            for (int32_t col = 0; col < m_width; ++col) {
+                const uint8_t counter = kernel_3x3_0(col, rows, kernel, color);
+                eval_3x3_0(row, col, 1.0 / counter, color);
+                color.set_all_zero();
+            }
+        });
+        return;
+    }
+    const std::array<double, 256>& decode = linear16_values();
+    std::vector<uint16_t> linear(static_cast<size_t>(m_width) * 3);
+    for_each_row_3x3([&](const int32_t row, const Pixel* const* rows) {
         for (int32_t col = 0; col < m_width; ++col) {
-            const uint8_t counter = kernel_3x3_0(row, col, copy, kernel, color);
-            eval_3x3_0(row, col, 1.0 / counter, color);
+            const uint8_t counter = kernel_3x3_0(col, rows, kernel, color,
+                [&decode](const uint8_t value) { return decode[value]; });
+            const double factor = 1.0 / counter;
+            store_linear16(PixelDouble(color.red * factor, color.green * factor, color.blue * factor),
+                &linear[col * 3]);
             color.set_all_zero();
         }
+        linear16_to_srgb(linear.data(), reinterpret_cast<uint8_t*>((*this)[row]), linear.size());
+    });
 }
 
-void Image3x8::gaussian_blur(const double std_deviation)
+// The source rows under the kernel are kept as a ring of edge padded copies; rows below the one being written are
+// still untouched, so the ring only has to be one kernel high.
+void Image3x8::gaussian_blur(const double std_deviation, const bool linear_light)
 {
+    if (m_height == 0 || m_width == 0)
+        return;
     const std::vector<double> kernel = make_gauss_kernel(std_deviation);
-    const Image3x8 copy = gaussian_copy(get_kernel_distance(kernel));
-    for (int32_t row = 0; row < m_height; ++row)
+    const int32_t distance = get_kernel_distance(kernel);
+    const int32_t diameter = distance * 2 + 1;
+    const int32_t padded_width = m_width + distance * 2;
+    std::vector<Pixel> ring(static_cast<size_t>(diameter) * padded_width);
+    auto line = [&](const int32_t row) {
+        return &ring[static_cast<size_t>((row % diameter + diameter) % diameter) * padded_width];
+    };
+    auto load = [&](const int32_t row) {
+        Pixel* padded = line(row);
+        const Pixel* source = (*this)[std::clamp(row, 0, m_height - 1)];
+        for (int32_t col = 0; col < padded_width; ++col)
+            padded[col] = source[std::clamp(col - distance, 0, m_width - 1)];
+    };
+    for (int32_t row = -distance; row < distance; ++row)
+        load(row);
+    std::vector<const Pixel*> rows(diameter);
+    const std::array<double, 256>& decode = linear16_values();
+    std::vector<uint16_t> linear(linear_light ? static_cast<size_t>(m_width) * 3 : 0);
+    for (int32_t row = 0; row < m_height; ++row) {
+        load(row + distance);
+        for (int32_t index = 0; index < diameter; ++index)
+            rows[index] = line(row - distance + index);
+        if (!linear_light) {
+            for (int32_t col = 0; col < m_width; ++col)
+                (*this)[row][col] = gaussian_kernel(col, rows.data(), kernel);
+            continue;
+        }
         for (int32_t col = 0; col < m_width; ++col)
-            (*this)[row][col] = gaussian_kernel(row, col, copy, kernel);
+            store_linear16(gaussian_sum(col, rows.data(), kernel,
+                [&decode](const uint8_t value) { return decode[value]; }), &linear[col * 3]);
+        linear16_to_srgb(linear.data(), reinterpret_cast<uint8_t*>((*this)[row]), linear.size());
+    }
 }
 
-void Image3x8::ridge()
+void Image3x8::median(const int32_t radius)
 {
+    if (radius <= 0)
+        return;
     const Image3x8 copy(*this);
+    median_filter(reinterpret_cast<const uint8_t*>(copy.m_pixels), reinterpret_cast<uint8_t*>(m_pixels),
+        m_height, m_width, 3, radius);
+}
+
+void Image3x8::bilateral(const double sigma_spatial, const double sigma_range)
+{
+    bilateral_filter(reinterpret_cast<uint8_t*>(m_pixels), m_height, m_width, 3, sigma_spatial, sigma_range);
+}
+
+void Image3x8::ridge()
+{
     PixelDouble color;
     const std::vector<int8_t> kernel = { 0, -1, 0, -1, 4, -1, 0, -1, 0 };
-    for (int32_t row = 0; row < m_height; ++row)
+    for_each_row_3x3([&](const int32_t row, const Pixel* const* rows) {
         for (int32_t col = 0; col < m_width; ++col) {
-            kernel_3x3_0(row, col, copy, kernel, color);
+            kernel_3x3_0(col, rows, kernel, color);
             eval_3x3_0(row, col, 1.0, color);
             color.set_all_zero();
         }
+    });
 }
 
 void Image3x8::sharpen()
 {
-    const Image3x8 copy(*this);
     PixelDouble color;
     const std::vector<int8_t> kernel = { 0, -1, 0, -1, 5, -1, 0, -1, 0 };
-    for (int32_t row = 0; row < m_height; ++row)
+    for_each_row_3x3([&](const int32_t row, const Pixel* const* rows) {
         for (int32_t col = 0; col < m_width; ++col) {
-            kernel_3x3_0(row, col, copy, kernel, color);
+            kernel_3x3_0(col, rows, kernel, color);
             eval_3x3_0(row, col, 1.0, color);
             color.set_all_zero();
         }
+    });
 }
 
-void Image3x8::emboss()
+void Image3x8::sharpen_luma()
+{
+    filter_luma(*this, [](ImageGray8& luma) { luma.sharpen(); });
+}
+
+void Image3x8::unsharp_mask(const double radius, const double amount, const int32_t threshold)
+{
+    unsharp_mask_filter(reinterpret_cast<uint8_t*>(m_pixels), m_height, m_width, 3, radius, amount, threshold);
+}
+
+void Image3x8::unsharp_mask_luma(const double radius, const double amount, const int32_t threshold)
+{
+    filter_luma(*this, [&](ImageGray8& luma) { luma.unsharp_mask(radius, amount, threshold); });
+}
+
+void Image3x8::adjust_hue_saturation(const double hue_shift, const double saturation)
+{
+    hue_saturation_filter(reinterpret_cast<uint8_t*>(m_pixels), m_height, m_width, hue_shift, saturation);
+}
+
+void Image3x8::convolve(const std::vector<double>& kernel, const int32_t kernel_width, const int32_t kernel_height)
 {
     const Image3x8 copy(*this);
+    convolve_filter(reinterpret_cast<const uint8_t*>(copy.m_pixels), reinterpret_cast<uint8_t*>(m_pixels),
+        m_height, m_width, 3, kernel, kernel_width, kernel_height);
+}
+
+void Image3x8::emboss()
+{
     PixelDouble color;
     const std::vector<int8_t> kernel = { -2, -1, 0, -1, 1, 1, 0, 1, 2 };
-    for (int32_t row = 0; row < m_height; ++row)
+    for_each_row_3x3([&](const int32_t row, const Pixel* const* rows) {
         for (int32_t col = 0; col < m_width; ++col) {
-            kernel_3x3_0(row, col, copy, kernel, color);
+            kernel_3x3_0(col, rows, kernel, color);
             eval_3x3_0(row, col, 1.0, color);
             color.set_all_zero();
         }
+    });
+}
+
+void Image3x8::resize(const int32_t new_height, const int32_t new_width, const ResizeFilter filter,
+    const bool linear_light)
+{
+    assert(0 < new_height && 0 < new_width && "resize to an empty image");
+    auto* pixels = new Pixel[new_height * new_width];
+    if (linear_light)
+        resize_linear_light(reinterpret_cast<const uint8_t*>(m_pixels), m_height, m_width,
+            reinterpret_cast<uint8_t*>(pixels), new_height, new_width, filter);
+    else
+        resample(reinterpret_cast<const uint8_t*>(m_pixels), m_height, m_width,
+            reinterpret_cast<uint8_t*>(pixels), new_height, new_width, 3, filter);
+    delete[] m_pixels;
+    m_pixels = pixels;
+    m_height = new_height;
+    m_width = new_width;
 }
 
 void Image3x8::eval_3x3_0(const int32_t row, const int32_t col, const double factor, const PixelDouble& color)
@@ -307,19 +513,19 @@ void Image3x8::eval_3x3_0(const int32_t row, const int32_t col, const double fac
 
 void Image3x8::edges()
 {
-    const Image3x8 copy(*this);
     PixelDouble color_x;
     PixelDouble color_y;
     const std::vector<int8_t> kernel_x = { -1, 0, 1, -2, 0, 2, -1, 0, 1 };
     const std::vector<int8_t> kernel_y = { -1, -2, -1, 0, 0, 0, 1, 2, 1 };
-    for (int32_t row = 0; row < m_height; ++row)
+    for_each_row_3x3([&](const int32_t row, const Pixel* const* rows) {
         for (int32_t col = 0; col < m_width; ++col) {
-            kernel_3x3_0(row, col, copy, kernel_x, color_x);
-            kernel_3x3_0(row, col, copy, kernel_y, color_y);
+            kernel_3x3_0(col, rows, kernel_x, color_x);
+            kernel_3x3_0(col, rows, kernel_y, color_y);
             evaluate_edges(row, col, color_x, color_y);
             color_x.set_all_zero();
             color_y.set_all_zero();
         }
+    });
 }
 
 void Image3x8::evaluate_edges(const int32_t row,
@@ -337,72 +543,59 @@ void Image3x8::evaluate_edges(const int32_t row,
         (*this)[row][col].blue = color.blue;
 }
 
-Image3x8 Image3x8::gaussian_copy(const int32_t distance)
+Pixel Image3x8::gaussian_kernel(const int32_t col_img,
+                                const Pixel* const* rows,
+                                const std::vector<double>& kernel)
 {
-    Image3x8 result(m_height + distance * 2, m_width + distance * 2);
-    for (int32_t row = 0; row < m_height; ++row)
-        for (int32_t col = 0; col < m_width; ++col)
-            result[row + distance][col + distance] = (*this)[row][col];
-    for (int32_t row = 0; row < m_height; ++row)
-        for (int32_t col = 0; col < distance; ++col) {
-            result[row + distance][col] = (*this)[row][0];
-            result[row + distance][col + m_width + distance] = (*this)[row][m_width - 1];
-        }
-    for (int32_t row = 0; row < distance; ++row) {
-        for (int32_t col = 0; col < m_width; ++col) {
-            result[row][col + distance] = (*this)[0][col];
-            result[row + m_height + distance][col + distance] = (*this)[m_height - 1][col];
-        }
-    }
-    for (int32_t row = 0; row < distance; ++row) {
-        for (int32_t col = 0; col < distance; ++col) {
-            result[row][col] = (*this)[0][0];
-            result[row + m_height + distance][col] = (*this)[m_height - 1][0];
-            result[row][col + m_width + distance] = (*this)[0][m_width - 1];
-            result[row + m_height + distance][col + m_width + distance] = (*this)[m_height - 1][m_width - 1];
-        }
-    }
-    return result;
+    return static_cast<Pixel>(gaussian_sum(col_img, rows, kernel, [](const uint8_t value) { return value; }));
 }
 
-Pixel Image3x8::gaussian_kernel(int32_t row_img,
-                                int32_t col_img,
-                                const Image3x8& copy,
-                                const std::vector<double>& kernel)
+template <typename Decode>
+PixelDouble Image3x8::gaussian_sum(const int32_t col_img,
+                                   const Pixel* const* rows,
+                                   const std::vector<double>& kernel,
+                                   Decode&& decode)
 {
     PixelDouble temp;
     int32_t index_kernel = 0;
     const int32_t kernel_distance = get_kernel_distance(kernel);
-    row_img += kernel_distance;
-    col_img += kernel_distance;
-    for (int32_t row = row_img - kernel_distance; row <= row_img + kernel_distance; ++row)
-        for (int32_t col = col_img - kernel_distance; col <= col_img + kernel_distance; ++col) {
-            temp.red += kernel[index_kernel] * copy[row][col].red;
-            temp.green += kernel[index_kernel] * copy[row][col].green;
-            temp.blue += kernel[index_kernel] * copy[row][col].blue;
+    for (int32_t row = 0; row <= 2 * kernel_distance; ++row)
+        for (int32_t col = col_img; col <= col_img + 2 * kernel_distance; ++col) {
+            temp.red += kernel[index_kernel] * decode(rows[row][col].red);
+            temp.green += kernel[index_kernel] * decode(rows[row][col].green);
+            temp.blue += kernel[index_kernel] * decode(rows[row][col].blue);
             ++index_kernel;
         }
-    return static_cast<Pixel>(temp);
+    return temp;
 }
 
-uint8_t Image3x8::kernel_3x3_0(const int32_t row_img,
-    const int32_t col_img,
-    const Image3x8& copy,
+uint8_t Image3x8::kernel_3x3_0(const int32_t col_img,
+    const Pixel* const* rows,
     const std::vector<int8_t>& kernel,
     PixelDouble& color) const
+{
+    return kernel_3x3_0(col_img, rows, kernel, color, [](const uint8_t value) { return value; });
+}
+
+template <typename Decode>
+uint8_t Image3x8::kernel_3x3_0(const int32_t col_img,
+    const Pixel* const* rows,
+    const std::vector<int8_t>& kernel,
+    PixelDouble& color,
+    Decode&& decode) const
 {
     uint8_t index = 0;
     uint8_t counter = 0;
-    for (int32_t row = row_img - 1; row <= row_img + 1; ++row) {
+    for (int32_t row = 0; row < 3; ++row) {
         for (int32_t col = col_img - 1; col <= col_img + 1; ++col) {
-            if (row <= -1 || m_height <= row)
+            if (rows[row] == nullptr)
                 continue;
             if (col <= -1 || m_width <= col)
                 continue;
             ++counter;
-            color.red += copy[row][col].red * kernel[index];
-            color.green += copy[row][col].green * kernel[index];
-            color.blue += copy[row][col].blue * kernel[index];
+            color.red += decode(rows[row][col].red) * kernel[index];
+            color.green += decode(rows[row][col].green) * kernel[index];
+            color.blue += decode(rows[row][col].blue) * kernel[index];
             ++index;
         }
     }
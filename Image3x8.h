@@ -3,11 +3,18 @@
 #ifndef IMAGE_H
 #define IMAGE_H
 
+#include "histogram.h"
+#include "resample.h"
+
+#include <array>
 #include <cstdint>
 #include <cstdio>
 #include <vector>
 
 struct PixelDouble;
+class ImageGray8;
+class ImagePyramid;
+enum class PyramidFilter : uint8_t;
 
 struct Pixel {
     uint8_t red;
@@ -20,6 +27,8 @@ struct Pixel {
     explicit Pixel(const PixelDouble& other);
 };
 
+static_assert(sizeof(Pixel) == 3, "Pixel rows are processed as packed RGB bytes");
+
 struct PixelDouble {
     double red;
     double green;
@@ -59,33 +68,63 @@ public:
     void sepia();
     void reflect_horizontal();
     void reflect_vertical();
-    void blur();
-    void gaussian_blur(double std_deviation);
+    // With `linear_light` the samples are averaged as linear light instead of as sRGB codes, which keeps edges
+    // between light and dark areas from darkening; kernel and edge handling are the same either way.
+    void blur(bool linear_light = false);
+    void gaussian_blur(double std_deviation, bool linear_light = false);
+    void median(int32_t radius);
+    void bilateral(double sigma_spatial, double sigma_range);
     void ridge();
     void sharpen();
+    void sharpen_luma();
+    void unsharp_mask(double radius, double amount, int32_t threshold);
+    void unsharp_mask_luma(double radius, double amount, int32_t threshold);
     void emboss();
     void edges();
     void color_mask(double red, double green, double blue);
+    void adjust_hue_saturation(double hue_shift, double saturation);
+    void convolve(const std::vector<double>& kernel, int32_t kernel_width, int32_t kernel_height);
+    // With `linear_light` the samples are resampled as linear light, as in blur.
+    void resize(int32_t new_height, int32_t new_width, ResizeFilter filter, bool linear_light = false);
+    void apply_lut(const Lut& red, const Lut& green, const Lut& blue);
+    void equalize();
+    void auto_levels(double clip_fraction);
 
     // ACCESSORS
     [[nodiscard]] std::vector<Image3x8> interlace() const;
+    [[nodiscard]] ImageGray8 to_grey_scale() const;
+    [[nodiscard]] ImageGray8 to_grey_scale_lum() const;
+    [[nodiscard]] ImagePyramid build_pyramid(int32_t levels, PyramidFilter filter) const;
     [[nodiscard]] std::vector<uint8_t> get_data() const;
+    [[nodiscard]] std::array<ChannelHistogram, 3> histogram() const;
+    [[nodiscard]] std::array<ChannelStatistics, 3> statistics() const;
     [[nodiscard]] int32_t height() const { return m_height; }
     [[nodiscard]] int32_t width() const { return m_width; }
     [[nodiscard]] uint32_t offset() const { return m_offset; }
     [[nodiscard]] size_t size() const { return m_height * m_width; }
     [[nodiscard]] const Pixel* operator[](const int32_t row) const { return m_pixels + m_width * row; }
 private:
-    uint8_t kernel_3x3_0(int32_t row_img,
-        int32_t col_img,
-        const Image3x8& copy,
+    template <typename Function>
+    void for_each_row_3x3(Function&& function);
+    uint8_t kernel_3x3_0(int32_t col_img,
+        const Pixel* const* rows,
         const std::vector<int8_t>& kernel,
         PixelDouble& color) const;
-    Image3x8 gaussian_copy(int32_t distance);
-    static Pixel gaussian_kernel(int32_t row_img,
-        int32_t col_img,
-        const Image3x8& copy,
+    // The same sums over samples passed through decode(sample).
+    template <typename Decode>
+    uint8_t kernel_3x3_0(int32_t col_img,
+        const Pixel* const* rows,
+        const std::vector<int8_t>& kernel,
+        PixelDouble& color,
+        Decode&& decode) const;
+    static Pixel gaussian_kernel(int32_t col_img,
+        const Pixel* const* rows,
         const std::vector<double>& kernel);
+    template <typename Decode>
+    static PixelDouble gaussian_sum(int32_t col_img,
+        const Pixel* const* rows,
+        const std::vector<double>& kernel,
+        Decode&& decode);
     void eval_3x3_0(int32_t row, int32_t col, double factor, const PixelDouble& color);
     void evaluate_edges(int32_t row, int32_t col, const PixelDouble& color_x, const PixelDouble& color_y);
     static inline void edges_pixel_helper(int32_t row, int32_t col, const Image3x8& copy, PixelDouble& color,
@@ -0,0 +1,261 @@
+#include "ImageGray8.h"
+
+#include "cpu_dispatch.h"
+#include "median.h"
+#include "unsharp.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+
+ImageGray8::ImageGray8()
+    : m_height(0), m_width(0)
+{
+}
+
+ImageGray8::ImageGray8(const int32_t height, const int32_t width)
+    : m_height(height), m_width(width), m_pixels(static_cast<size_t>(height) * width)
+{
+}
+
+ImageGray8::ImageGray8(const std::vector<uint8_t>& data, const int32_t height, const int32_t width)
+    : m_height(height), m_width(width), m_pixels(data)
+{
+    assert(data.size() == static_cast<size_t>(height) * width && "grey data does not match the image size");
+}
+
+// Calls function(row, rows) with the original rows above, at and below `row` (nullptr outside the image) while
+// `row` is rewritten in place, like Image3x8::for_each_row_3x3.
+template <typename Function>
+void ImageGray8::for_each_row_3x3(Function&& function)
+{
+    std::vector<uint8_t> ring(2 * static_cast<size_t>(m_width));
+    uint8_t* previous = ring.data();
+    uint8_t* current = ring.data() + m_width;
+    for (int32_t row = 0; row < m_height; ++row) {
+        std::copy_n((*this)[row], m_width, current);
+        const uint8_t* rows[3] = { row == 0 ? nullptr : previous, current,
+            row + 1 == m_height ? nullptr : (*this)[row + 1] };
+        function(row, rows);
+        std::swap(previous, current);
+    }
+}
+
+// Kernel sums for a whole row with the edge handling of Image3x8::kernel_3x3_0: samples outside the image are
+// skipped and the kernel index only advances over the ones inside. `counts` gets the number of samples.
+static void sum_row_3x3(const uint8_t* const* rows, const int32_t width, const std::array<int8_t, 9>& kernel,
+    int32_t* sums, uint8_t* counts)
+{
+    auto sum_edge = [&](const int32_t col) {
+        int32_t sum = 0;
+        uint8_t index = 0;
+        for (int32_t row = 0; row < 3; ++row)
+            for (int32_t x = col - 1; x <= col + 1; ++x) {
+                if (rows[row] == nullptr || x < 0 || width <= x)
+                    continue;
+                sum += rows[row][x] * kernel[index++];
+            }
+        sums[col] = sum;
+        counts[col] = index;
+    };
+    if (rows[0] == nullptr || rows[2] == nullptr || width < 3) {
+        for (int32_t col = 0; col < width; ++col)
+            sum_edge(col);
+        return;
+    }
+    sum_edge(0);
+    for (int32_t col = 1; col + 1 < width; ++col) {
+        int32_t sum = 0;
+        for (int32_t row = 0; row < 3; ++row)
+            sum += kernel[3 * row] * rows[row][col - 1] + kernel[3 * row + 1] * rows[row][col]
+                + kernel[3 * row + 2] * rows[row][col + 1];
+        sums[col] = sum;
+        counts[col] = 9;
+    }
+    sum_edge(width - 1);
+}
+
+static uint8_t clamp_byte(const double value)
+{
+    return static_cast<uint8_t>(std::clamp(value, 0.0, 255.0));
+}
+
+void ImageGray8::blur()
+{
+    constexpr std::array<int8_t, 9> kernel = { 1, 1, 1, 1, 1, 1, 1, 1, 1 };
+    std::vector<int32_t> sums(m_width);
+    std::vector<uint8_t> counts(m_width);
+    for_each_row_3x3([&](const int32_t row, const uint8_t* const* rows) {
+        sum_row_3x3(rows, m_width, kernel, sums.data(), counts.data());
+        uint8_t* dst = (*this)[row];
+        for (int32_t col = 0; col < m_width; ++col)
+            dst[col] = clamp_byte(sums[col] * (1.0 / counts[col]));
+    });
+}
+
+void ImageGray8::sharpen()
+{
+    constexpr std::array<int8_t, 9> kernel = { 0, -1, 0, -1, 5, -1, 0, -1, 0 };
+    std::vector<int32_t> sums(m_width);
+    std::vector<uint8_t> counts(m_width);
+    for_each_row_3x3([&](const int32_t row, const uint8_t* const* rows) {
+        sum_row_3x3(rows, m_width, kernel, sums.data(), counts.data());
+        uint8_t* dst = (*this)[row];
+        for (int32_t col = 0; col < m_width; ++col)
+            dst[col] = static_cast<uint8_t>(std::clamp(sums[col], 0, 255));
+    });
+}
+
+void ImageGray8::edges()
+{
+    constexpr std::array<int8_t, 9> kernel_x = { -1, 0, 1, -2, 0, 2, -1, 0, 1 };
+    constexpr std::array<int8_t, 9> kernel_y = { -1, -2, -1, 0, 0, 0, 1, 2, 1 };
+    constexpr int32_t limit = 100;
+    std::vector<int32_t> sums_x(m_width);
+    std::vector<int32_t> sums_y(m_width);
+    std::vector<uint8_t> counts(m_width);
+    for_each_row_3x3([&](const int32_t row, const uint8_t* const* rows) {
+        sum_row_3x3(rows, m_width, kernel_x, sums_x.data(), counts.data());
+        sum_row_3x3(rows, m_width, kernel_y, sums_y.data(), counts.data());
+        uint8_t* dst = (*this)[row];
+        for (int32_t col = 0; col < m_width; ++col) {
+            const double x = sums_x[col];
+            const double y = sums_y[col];
+            const uint8_t magnitude = clamp_byte(std::sqrt(x * x + y * y));
+            if (limit <= std::abs(dst[col] - magnitude))
+                dst[col] = magnitude;
+        }
+    });
+}
+
+// Same kernel, edge replication and rounding as Image3x8::gaussian_blur; each tap is accumulated over the whole
+// row so the loop runs along contiguous bytes.
+void ImageGray8::gaussian_blur(const double std_deviation)
+{
+    if (m_height == 0 || m_width == 0)
+        return;
+    const std::vector<double> kernel = make_gauss_kernel(std_deviation);
+    const int32_t distance = get_kernel_distance(kernel);
+    const int32_t diameter = distance * 2 + 1;
+    const int32_t padded_width = m_width + distance * 2;
+    std::vector<uint8_t> ring(static_cast<size_t>(diameter) * padded_width);
+    auto line = [&](const int32_t row) {
+        return &ring[static_cast<size_t>((row % diameter + diameter) % diameter) * padded_width];
+    };
+    auto load = [&](const int32_t row) {
+        uint8_t* padded = line(row);
+        const uint8_t* source = (*this)[std::clamp(row, 0, m_height - 1)];
+        std::fill_n(padded, distance, source[0]);
+        std::copy_n(source, m_width, padded + distance);
+        std::fill_n(padded + distance + m_width, distance, source[m_width - 1]);
+    };
+    for (int32_t row = -distance; row < distance; ++row)
+        load(row);
+    std::vector<double> sums(m_width);
+    for (int32_t row = 0; row < m_height; ++row) {
+        load(row + distance);
+        std::fill(sums.begin(), sums.end(), 0.0);
+        for (int32_t tap_y = 0; tap_y < diameter; ++tap_y) {
+            const uint8_t* source = line(row - distance + tap_y);
+            for (int32_t tap_x = 0; tap_x < diameter; ++tap_x) {
+                const double weight = kernel[tap_y * diameter + tap_x];
+                for (int32_t col = 0; col < m_width; ++col)
+                    sums[col] += weight * source[col + tap_x];
+            }
+        }
+        uint8_t* dst = (*this)[row];
+        for (int32_t col = 0; col < m_width; ++col)
+            dst[col] = static_cast<uint8_t>(std::clamp(sums[col], 0.0, 255.0) + 0.5);
+    }
+}
+
+void ImageGray8::median(const int32_t radius)
+{
+    if (radius <= 0)
+        return;
+    const std::vector<uint8_t> copy(m_pixels);
+    median_filter(copy.data(), m_pixels.data(), m_height, m_width, 1, radius);
+}
+
+void ImageGray8::unsharp_mask(const double radius, const double amount, const int32_t threshold)
+{
+    unsharp_mask_filter(m_pixels.data(), m_height, m_width, 1, radius, amount, threshold);
+}
+
+void ImageGray8::resize(const int32_t new_height, const int32_t new_width, const ResizeFilter filter)
+{
+    assert(0 < new_height && 0 < new_width && "resize to an empty image");
+    std::vector<uint8_t> pixels(static_cast<size_t>(new_height) * new_width);
+    resample(m_pixels.data(), m_height, m_width, pixels.data(), new_height, new_width, 1, filter);
+    m_pixels.swap(pixels);
+    m_height = new_height;
+    m_width = new_width;
+}
+
+void ImageGray8::apply_lut(const Lut& lut)
+{
+    apply_luts(m_pixels.data(), size(), 1, &lut);
+}
+
+void ImageGray8::equalize()
+{
+    apply_lut(make_equalize_lut(histogram()));
+}
+
+void ImageGray8::auto_levels(const double clip_fraction)
+{
+    apply_lut(make_levels_lut(histogram(), clip_fraction));
+}
+
+Image3x8 ImageGray8::to_rgb() const
+{
+    Image3x8 result(m_height, m_width);
+    grey_to_rgb(m_pixels.data(), reinterpret_cast<uint8_t*>(result[0]), size());
+    return result;
+}
+
+ChannelHistogram ImageGray8::histogram() const
+{
+    ChannelHistogram result;
+    build_histograms(m_pixels.data(), size(), 1, &result);
+    return result;
+}
+
+ChannelStatistics ImageGray8::statistics() const
+{
+    return ChannelStatistics(histogram());
+}
+
+void rgb_to_grey(const uint8_t* rgb, uint8_t* grey, const size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        const double value = rgb[i * 3] + rgb[i * 3 + 1] * 0.7152 + rgb[i * 3 + 2];
+        grey[i] = clamp_byte((value + 0.5) / 3);
+    }
+}
+
+void rgb_to_grey_lum(const uint8_t* rgb, uint8_t* grey, const size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        const double value = rgb[i * 3] * 0.2126 + rgb[i * 3 + 1] * 0.7152 + rgb[i * 3 + 2] * 0.0722;
+        grey[i] = clamp_byte((value + 0.5) / 3);
+    }
+}
+
+SIMD_INLINE void grey_to_rgb_body(const uint8_t* grey, uint8_t* rgb, const size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        rgb[i * 3] = grey[i];
+        rgb[i * 3 + 1] = grey[i];
+        rgb[i * 3 + 2] = grey[i];
+    }
+}
+
+SIMD_DISPATCH(void, grey_to_rgb_dispatch, grey_to_rgb_body, (const uint8_t* grey, uint8_t* rgb, const size_t count),
+    (grey, rgb, count))
+
+void grey_to_rgb(const uint8_t* grey, uint8_t* rgb, const size_t count)
+{
+    grey_to_rgb_dispatch(grey, rgb, count);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#ifndef IMAGE_GRAY8_H
+#define IMAGE_GRAY8_H
+
+#include "Image3x8.h"
+#include "histogram.h"
+#include "resample.h"
+
+#include <cstdint>
+#include <vector>
+
+// One byte per pixel. The filters give the same values as the matching Image3x8 filter gives on each channel.
+class ImageGray8 {
+    int32_t m_height;
+    int32_t m_width;
+    std::vector<uint8_t> m_pixels;
+
+public:
+    // CREATORS
+    ImageGray8();
+    ImageGray8(int32_t height, int32_t width);
+    ImageGray8(const std::vector<uint8_t>& data, int32_t height, int32_t width);
+
+    // MANIPULATORS
+    uint8_t* operator[](const int32_t row) { return m_pixels.data() + static_cast<size_t>(m_width) * row; }
+    void blur();
+    void gaussian_blur(double std_deviation);
+    void sharpen();
+    void edges();
+    void median(int32_t radius);
+    void unsharp_mask(double radius, double amount, int32_t threshold);
+    void resize(int32_t new_height, int32_t new_width, ResizeFilter filter);
+    void apply_lut(const Lut& lut);
+    void equalize();
+    void auto_levels(double clip_fraction);
+
+    // ACCESSORS
+    [[nodiscard]] Image3x8 to_rgb() const;
+    [[nodiscard]] ChannelHistogram histogram() const;
+    [[nodiscard]] ChannelStatistics statistics() const;
+    [[nodiscard]] const std::vector<uint8_t>& data() const { return m_pixels; }
+    [[nodiscard]] int32_t height() const { return m_height; }
+    [[nodiscard]] int32_t width() const { return m_width; }
+    [[nodiscard]] size_t size() const { return m_pixels.size(); }
+    [[nodiscard]] const uint8_t* operator[](const int32_t row) const
+    {
+        return m_pixels.data() + static_cast<size_t>(m_width) * row;
+    }
+private:
+    template <typename Function>
+    void for_each_row_3x3(Function&& function);
+};
+
+// Packed RGB to grey with the weights of Image3x8::grey_scale and grey_scale_lum, and back.
+void rgb_to_grey(const uint8_t* rgb, uint8_t* grey, size_t count);
+void rgb_to_grey_lum(const uint8_t* rgb, uint8_t* grey, size_t count);
+void grey_to_rgb(const uint8_t* grey, uint8_t* rgb, size_t count);
+
+#endif //IMAGE_GRAY8_H
@@ -0,0 +1,96 @@
+#include "Pyramid.h"
+
+#include <algorithm>
+#include <cassert>
+
+ImagePyramid::ImagePyramid(const Image3x8& image, const int32_t levels, const PyramidFilter filter)
+{
+    assert(0 < levels && "a pyramid needs at least one level");
+    size_t total = 0;
+    int32_t height = image.height();
+    int32_t width = image.width();
+    for (int32_t level = 0; level < levels; ++level) {
+        m_offsets.push_back(total);
+        m_heights.push_back(height);
+        m_widths.push_back(width);
+        total += static_cast<size_t>(height) * width;
+        if (height == 1 && width == 1)
+            break;
+        height = (height + 1) / 2;
+        width = (width + 1) / 2;
+    }
+    m_pixels.resize(total);
+    std::vector<int32_t> rows_done(m_heights.size(), 0);
+    std::vector<uint16_t> sums(static_cast<size_t>(image.width()) * 3);
+    for (int32_t row = 0; row < image.height(); ++row) {
+        std::copy_n(image[row], image.width(), mutable_row(0, row));
+        rows_done[0] = row + 1;
+        for (int32_t level = 1; level < this->levels(); ++level) {
+            const int32_t last_input = m_heights[level - 1] - 1;
+            while (rows_done[level] < m_heights[level]) {
+                const int32_t next = rows_done[level];
+                const int32_t reach = filter == PyramidFilter::Box ? 2 * next + 1 : 2 * next + 2;
+                if (rows_done[level - 1] <= std::min(reach, last_input))
+                    break;
+                reduce_row(level, next, filter, sums);
+                ++rows_done[level];
+            }
+        }
+    }
+}
+
+ImagePyramid Image3x8::build_pyramid(const int32_t levels, const PyramidFilter filter) const
+{
+    return { *this, levels, filter };
+}
+
+Image3x8 ImagePyramid::level_image(const int32_t level) const
+{
+    Image3x8 result(m_heights[level], m_widths[level]);
+    for (int32_t row = 0; row < m_heights[level]; ++row)
+        std::copy_n(this->row(level, row), m_widths[level], result[row]);
+    return result;
+}
+
+void ImagePyramid::reduce_row(const int32_t level, const int32_t row, const PyramidFilter filter,
+    std::vector<uint16_t>& sums)
+{
+    const int32_t src_height = m_heights[level - 1];
+    const int32_t src_width = m_widths[level - 1];
+    const int32_t dst_width = m_widths[level];
+    const size_t length = static_cast<size_t>(src_width) * 3;
+    auto src_row = [&](const int32_t index) {
+        return reinterpret_cast<const uint8_t*>(this->row(level - 1, std::clamp(index, 0, src_height - 1)));
+    };
+    auto* dst = reinterpret_cast<uint8_t*>(mutable_row(level, row));
+    if (filter == PyramidFilter::Box) {
+        const uint8_t* top = src_row(2 * row);
+        const uint8_t* bottom = src_row(2 * row + 1);
+        for (size_t i = 0; i < length; ++i)
+            sums[i] = top[i] + bottom[i];
+        for (int32_t col = 0; col < dst_width; ++col) {
+            const size_t left = static_cast<size_t>(2 * col) * 3;
+            const size_t right = static_cast<size_t>(std::min(2 * col + 1, src_width - 1)) * 3;
+            for (int32_t channel = 0; channel < 3; ++channel)
+                dst[col * 3 + channel] = (sums[left + channel] + sums[right + channel] + 2) >> 2;
+        }
+        return;
+    }
+    const uint8_t* r0 = src_row(2 * row - 2);
+    const uint8_t* r1 = src_row(2 * row - 1);
+    const uint8_t* r2 = src_row(2 * row);
+    const uint8_t* r3 = src_row(2 * row + 1);
+    const uint8_t* r4 = src_row(2 * row + 2);
+    for (size_t i = 0; i < length; ++i)
+        sums[i] = r0[i] + 4 * (r1[i] + r3[i]) + 6 * r2[i] + r4[i];
+    for (int32_t col = 0; col < dst_width; ++col) {
+        size_t taps[5];
+        for (int32_t k = 0; k < 5; ++k)
+            taps[k] = static_cast<size_t>(std::clamp(2 * col - 2 + k, 0, src_width - 1)) * 3;
+        for (int32_t channel = 0; channel < 3; ++channel) {
+            const uint32_t sum = sums[taps[0] + channel] + 4 * (sums[taps[1] + channel] + sums[taps[3] + channel])
+                + 6 * sums[taps[2] + channel] + sums[taps[4] + channel];
+            dst[col * 3 + channel] = (sum + 128) >> 8;
+        }
+    }
+}
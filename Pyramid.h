@@ -0,0 +1,46 @@
+#pragma once
+
+#ifndef PYRAMID_H
+#define PYRAMID_H
+
+#include "Image3x8.h"
+
+#include <cstdint>
+#include <vector>
+
+enum class PyramidFilter : uint8_t {
+    Box,
+    Binomial
+};
+
+// All levels of a 2x pyramid in one contiguous buffer, level 0 being the full resolution image.
+class ImagePyramid {
+    std::vector<Pixel> m_pixels;
+    std::vector<size_t> m_offsets;
+    std::vector<int32_t> m_heights;
+    std::vector<int32_t> m_widths;
+
+public:
+    // CREATORS
+    ImagePyramid(const Image3x8& image, int32_t levels, PyramidFilter filter);
+
+    // ACCESSORS
+    [[nodiscard]] int32_t levels() const { return static_cast<int32_t>(m_heights.size()); }
+    [[nodiscard]] int32_t height(const int32_t level) const { return m_heights[level]; }
+    [[nodiscard]] int32_t width(const int32_t level) const { return m_widths[level]; }
+    [[nodiscard]] const Pixel* level_data(const int32_t level) const { return m_pixels.data() + m_offsets[level]; }
+    [[nodiscard]] const Pixel* row(const int32_t level, const int32_t row) const
+    {
+        return level_data(level) + static_cast<size_t>(row) * m_widths[level];
+    }
+    [[nodiscard]] const std::vector<Pixel>& data() const { return m_pixels; }
+    [[nodiscard]] Image3x8 level_image(int32_t level) const;
+private:
+    [[nodiscard]] Pixel* mutable_row(const int32_t level, const int32_t row)
+    {
+        return m_pixels.data() + m_offsets[level] + static_cast<size_t>(row) * m_widths[level];
+    }
+    void reduce_row(int32_t level, int32_t row, PyramidFilter filter, std::vector<uint16_t>& sums);
+};
+
+#endif //PYRAMID_H
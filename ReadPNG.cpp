@@ -1,9 +1,26 @@
 #include "ReadPNG.h"
 
+#include "checksum.h"
+#include "inflate.h"
+#include "parallel.h"
+#include "png_helpers.h"
+
+#include <algorithm>
 #include <cassert>
-#include <cmath>
+#include <exception>
 #include <fstream>
 #include <iostream>
+#include <thread>
+#include <utility>
+
+// Decoding is pipelined over two threads from this many bytes of scanlines, in batches of s_pipeline_batch bytes of
+// which s_pipeline_batches can be in flight.
+static constexpr size_t s_pipeline_size = size_t(1) << 20;
+static constexpr size_t s_pipeline_batch = size_t(1) << 17;
+static constexpr size_t s_pipeline_batches = 8;
+// The largest image read, 2^28 pixels or 768 MiB as RGB: the image is allocated from the header before any image
+// data is read, so a few bytes of a damaged or hostile file could otherwise ask for any amount of memory.
+static constexpr int64_t s_max_pixels = int64_t(1) << 28;
 
 const uint8_t ReadPNG::s_signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
 
@@ -13,8 +30,8 @@ IHDR::IHDR()
 
 IHDR::IHDR(const Chunk& chunk)
 {
-    width = get_uint32_t_from_data(chunk.data, 0);
-    height = get_uint32_t_from_data(chunk.data, 4);
+    width = get_uint32_t_from_data(chunk.data.data(), 0);
+    height = get_uint32_t_from_data(chunk.data.data(), 4);
     bit_depth = chunk.data[8];
     color_type = chunk.data[9];
     compression_method = chunk.data[10];
@@ -30,34 +47,28 @@ bool Chunk::check_crc(const uint32_t calculated_crc) const
     return crc_file == calculated_crc;
 }
 
-void Chunk::create_crc_table()
+// The markers of an rsTR chunk, or none when it doesn't hold a valid list for `height` rows; the chunk is
+// ancillary, so a bad one only costs the parallel decode.
+static std::vector<RestartMarker> read_restart_markers(const Chunk& chunk, const int32_t height)
 {
-    for (int32_t n = 0; n < 256; n++) {
-        auto c = static_cast<uint32_t>(n);
-        for (int32_t k = 0; k < 8; k++) {
-            if (c & 1)
-                c = 0xedb88320L ^ (c >> 1);
-            else
-                c = c >> 1;
-        }
-        crc_table[n] = c;
+    std::vector<RestartMarker> markers;
+    if (chunk.data.empty() || chunk.data.size() % 8 != 0)
+        return markers;
+    for (size_t i = 0; i < chunk.data.size(); i += 8) {
+        const RestartMarker marker = { get_uint32_t_from_data(chunk.data.data(), static_cast<int32_t>(i)),
+            get_uint32_t_from_data(chunk.data.data(), static_cast<int32_t>(i + 4)) };
+        const bool rising = markers.empty()
+            ? marker.row == 0 && marker.offset == 2
+            : markers.back().row < marker.row && markers.back().offset < marker.offset;
+        if (!rising || static_cast<uint32_t>(height) <= marker.row)
+            return {};
+        markers.push_back(marker);
     }
+    return markers;
 }
 
-unsigned long Chunk::update_crc(const uint32_t crc, const std::vector<uint8_t>& buffer)
-{
-    unsigned long c = crc;
-    for (const uint8_t buf : buffer)
-        c = crc_table[(c ^ buf) & 0xff] ^ (c >> 8);
-    return c;
-}
-
-unsigned long Chunk::get_crc(const std::vector<uint8_t>& buffer)
-{
-    return update_crc(0xffffffffL, buffer) ^ 0xffffffffL;
-}
-
-ReadPNG::ReadPNG(const char* path)
+ReadPNG::ReadPNG(const char* path, const ChecksumPolicy checksum_policy)
+    : m_checksum_policy(checksum_policy), m_checksums_valid(true)
 {
     std::ifstream ifs;
     ifs.open(path, std::ios::in | std::ios::binary);
@@ -68,8 +79,6 @@ ReadPNG::ReadPNG(const char* path)
     this->c_path = path;
     if (!read_signature(ifs))
         throw std::exception();
-    Chunk::create_crc_table();
-    std::vector<uint8_t> data;
     Chunk chunk;
     read_chunk(ifs, chunk);
     m_chunks.push_back(chunk);
@@ -78,12 +87,51 @@ ReadPNG::ReadPNG(const char* path)
         throw std::exception();
     }
     m_header = IHDR(chunk);
+    if (m_header.width <= 0 || m_header.height <= 0 || m_header.compression_method != 0
+        || m_header.filter_method != 0 || 1 < m_header.interlace_method) {
+        std::cout << "Faulty IHDR";
+        throw std::exception();
+    }
+    if (s_max_pixels < static_cast<int64_t>(m_header.width) * m_header.height) {
+        std::cout << "Image too large " << m_header.width << 'x' << m_header.height;
+        throw std::exception();
+    }
+    if (!PngPixelFormat::valid(m_header.color_type, m_header.bit_depth)) {
+        std::cout << "Faulty color type and bit depth";
+        throw std::exception();
+    }
+    PngPixelFormat format(m_header.color_type, m_header.bit_depth);
+    std::vector<RestartMarker> markers;
+    bool image_read = false;
+    read_chunk(ifs, chunk);
     while (chunk.name != "IEND") {
-        read_chunk(ifs, chunk);
-        m_chunks.push_back(chunk);
+        if (chunk.name != "IDAT") {
+            if (chunk.name == "PLTE" && !image_read)
+                format.set_palette(chunk.data.data(), chunk.data.size());
+            else if (chunk.name == "tRNS" && !image_read)
+                format.set_transparency(chunk.data.data(), chunk.data.size());
+            else if (chunk.name == "rsTR" && !image_read)
+                markers = read_restart_markers(chunk, m_header.height);
+            m_chunks.push_back(chunk);
+            read_chunk(ifs, chunk);
+            continue;
+        }
+        if (image_read) {
+            std::cout << "IDAT chunks are not consecutive";
+            throw std::exception();
+        }
+        if (m_header.color_type == 3 && !format.has_palette()) {
+            std::cout << "Palette image without PLTE";
+            throw std::exception();
+        }
+        read_image_data(ifs, chunk, format, markers);
+        image_read = true;
+    }
+    m_chunks.push_back(chunk);
+    if (!image_read) {
+        std::cout << "No image data";
+        throw std::exception();
     }
-    std::vector<uint8_t> compressed_data = get_idat_data();
-    std::cout << "done";
 }
 
 bool ReadPNG::read_signature(std::ifstream& ifs)
@@ -99,61 +147,250 @@ bool ReadPNG::read_signature(std::ifstream& ifs)
     return true;
 }
 
+// Reads the chunk into `chunk`, reusing its buffer.
 bool ReadPNG::read_chunk(std::ifstream& ifs, Chunk& chunk)
 {
-    std::vector<uint8_t> temp(4);
-    ifs.read(reinterpret_cast<char*>(&temp[0]), 4);
-    chunk.length = get_uint32_t_from_data(temp, 0);
-    std::vector<uint8_t> buffer(chunk.length + 4);
-    ifs.read(reinterpret_cast<char*>(&buffer[0]), chunk.length + 4);
+    uint8_t header[8];
+    ifs.read(reinterpret_cast<char*>(header), 8);
+    if (!ifs) {
+        std::cout << "Unexpected end of file";
+        throw std::exception();
+    }
+    chunk.length = get_uint32_t_from_data(header, 0);
+    chunk.name = get_chunk_name(header + 4);
+    chunk.data.resize(chunk.length);
+    ifs.read(reinterpret_cast<char*>(chunk.data.data()), static_cast<std::streamsize>(chunk.length));
     ifs.read(reinterpret_cast<char*>(&chunk.crc[0]), 4);
-    if (!chunk.check_crc(Chunk::get_crc(buffer))) {
+    if (!ifs) {
+        std::cout << "Unexpected end of file";
+        throw std::exception();
+    }
+    if (m_checksum_policy == ChecksumPolicy::Skip)
+        return true;
+    if (!chunk.check_crc(crc32(crc32(0, header + 4, 4), chunk.data.data(), chunk.data.size()))) {
+        if (m_checksum_policy == ChecksumPolicy::Defer) {
+            m_checksums_valid = false;
+            return true;
+        }
         std::cout << "Faulty crc code";
         throw std::exception();
     }
-    for (int32_t i = 0; i < 4; ++i)
-        temp[i] = buffer[i];
-    chunk.name = get_chunk_name(temp);
-    chunk.data.resize(chunk.length);
-    for (int32_t i = 0; i < chunk.length; ++i)
-        chunk.data[i] = buffer[i + 4];
     return true;
 }
 
-int32_t ReadPNG::get_idat_data_length()
+// Inflates the IDAT chunks one at a time as they are read, starting with `chunk`, and unfilters and expands the
+// scanlines as they come out, on a second thread for large images; the scanlines of an interlaced image are
+// scattered to their Adam7 positions. With
+// restart markers the IDAT chunks are read whole and decoded in bands instead, or sequentially from the buffer when
+// the markers turn out not to fit the stream. Leaves the chunk after the last IDAT in `chunk`.
+void ReadPNG::read_image_data(std::ifstream& ifs, Chunk& chunk, PngPixelFormat& format,
+    const std::vector<RestartMarker>& markers)
 {
-    int32_t length = 0;
-    for (const Chunk& chunk : m_chunks)
-        if (chunk.name == "IDAT")
-            length += chunk.length;
-    return length;
+    const int32_t height = m_header.height;
+    const int32_t width = m_header.width;
+    const bool interlaced = m_header.interlace_method == 1;
+    const bool alpha = format.has_alpha();
+    m_image = Image3x8(height, width);
+    if (alpha)
+        m_image_rgba = Image<PixelRGBA8>(height, width);
+    std::vector<ScanlinePass> passes;
+    if (!interlaced)
+        passes.push_back({ height, format.row_bytes(width) });
+    else
+        for (const Adam7Pass& pass : s_adam7_passes)
+            passes.push_back({ adam7_count(height, pass.first_row, pass.row_step),
+                format.row_bytes(adam7_count(width, pass.first_col, pass.col_step)) });
+    ScanlineReader scanlines(std::move(passes), format.bytes_per_pixel());
+    std::vector<uint8_t> line;
+    const auto store_row = [&](const int32_t pass, const int32_t row, const uint8_t* bytes) {
+        if (!interlaced) {
+            expand_row(format, row, bytes);
+            return;
+        }
+        const Adam7Pass& adam7 = s_adam7_passes[pass];
+        const int32_t cols = adam7_count(width, adam7.first_col, adam7.col_step);
+        const int32_t image_row = adam7.first_row + row * adam7.row_step;
+        line.resize(static_cast<size_t>(cols) * 4);
+        if (alpha)
+            format.expand_rgba(bytes, cols, line.data());
+        else
+            format.expand_rgb(bytes, cols, line.data());
+        const size_t channels = alpha ? 4 : 3;
+        for (int32_t col = 0; col < cols; ++col) {
+            const uint8_t* pixel = line.data() + col * channels;
+            const int32_t image_col = adam7.first_col + col * adam7.col_step;
+            std::copy_n(pixel, 3, reinterpret_cast<uint8_t*>(&m_image[image_row][image_col]));
+            if (alpha)
+                std::copy_n(pixel, 4, m_image_rgba[image_row][image_col].samples);
+        }
+    };
+    std::vector<uint8_t> stream;
+    const bool buffered = !interlaced && !markers.empty();
+    if (buffered) {
+        while (chunk.name == "IDAT") {
+            stream.insert(stream.end(), chunk.data.begin(), chunk.data.end());
+            read_chunk(ifs, chunk);
+        }
+        if (6 <= stream.size() && markers.back().offset < stream.size() - 4
+            && read_restart_bands(stream, format, markers))
+            return;
+    }
+    bool first = true;
+    const InflateSource source = [&](const uint8_t*& data, size_t& size) {
+        if (buffered) {
+            data = stream.data();
+            size = stream.size();
+            return std::exchange(first, false);
+        }
+        if (!first) {
+            read_chunk(ifs, chunk);
+            if (chunk.name != "IDAT")
+                return false;
+        }
+        first = false;
+        data = chunk.data.data();
+        size = chunk.data.size();
+        return true;
+    };
+    if (thread_count() == 1 || height * format.row_bytes(width) < s_pipeline_size) {
+        const InflateSink sink = [&](const uint8_t* data, const size_t size) {
+            scanlines.push(data, size, store_row);
+        };
+        if (!zlib_decompress(source, sink, m_checksum_policy).checksum_valid)
+            m_checksums_valid = false;
+    } else {
+        // Inflating stays on this thread, which also reads the file, and hands its output in batches to a second
+        // thread that unfilters and expands the scanlines, so that the two overlap.
+        SpscRing<std::vector<uint8_t> > ring(s_pipeline_batches);
+        std::exception_ptr unfilter_error;
+        std::thread unfilter_thread([&] {
+            try {
+                while (const std::vector<uint8_t>* batch = ring.front()) {
+                    scanlines.push(batch->data(), batch->size(), store_row);
+                    ring.pop();
+                }
+            } catch (...) {
+                unfilter_error = std::current_exception();
+                ring.cancel();
+            }
+        });
+        std::vector<uint8_t>* batch = nullptr;
+        const InflateSink sink = [&](const uint8_t* data, size_t size) {
+            while (size != 0) {
+                if (batch == nullptr) {
+                    batch = ring.acquire();
+                    if (batch == nullptr)
+                        throw std::exception();
+                    batch->clear();
+                }
+                const size_t count = std::min(size, s_pipeline_batch - batch->size());
+                batch->insert(batch->end(), data, data + count);
+                data += count;
+                size -= count;
+                if (batch->size() == s_pipeline_batch) {
+                    ring.publish();
+                    batch = nullptr;
+                }
+            }
+        };
+        std::exception_ptr inflate_error;
+        try {
+            if (!zlib_decompress(source, sink, m_checksum_policy).checksum_valid)
+                m_checksums_valid = false;
+            if (batch != nullptr)
+                ring.publish();
+        } catch (...) {
+            inflate_error = std::current_exception();
+        }
+        ring.close();
+        unfilter_thread.join();
+        // When unfiltering failed first, inflating only stopped because of it.
+        if (unfilter_error)
+            std::rethrow_exception(unfilter_error);
+        if (inflate_error)
+            std::rethrow_exception(inflate_error);
+    }
+    if (!scanlines.done()) {
+        std::cout << "Image data is shorter than the header says";
+        throw std::exception();
+    }
+    while (chunk.name == "IDAT")
+        read_chunk(ifs, chunk);
 }
 
-std::vector<uint8_t> ReadPNG::get_idat_data()
+// Inflates and unfilters the bands between restart markers on their own threads, then checks the Adler-32 of the
+// whole stream from theirs. False when a band fails or the Adler-32 doesn't match, which is what stale markers left
+// behind by an encoder that recompressed the stream look like; the caller then decodes the stream sequentially and
+// only fails if that fails too. Under ChecksumPolicy::Skip there is no Adler-32 to compare, so markers that are
+// misplaced but still land on block boundaries of a valid stream go undetected.
+bool ReadPNG::read_restart_bands(const std::vector<uint8_t>& stream, const PngPixelFormat& format,
+    const std::vector<RestartMarker>& markers)
 {
-    std::vector<uint8_t> result(get_idat_data_length());
-    int32_t index = 0;
-    for (const Chunk& chunk : m_chunks)
-        if (chunk.name == "IDAT")
-            for (const uint8_t data : chunk.data) {
-                result[index] = data;
-                ++index;
+    if ((stream[0] & 0x0f) != 8 || 7 < stream[0] >> 4 || (stream[0] << 8 | stream[1]) % 31 != 0
+        || (stream[1] & 0x20) != 0)
+        return false;
+    const auto count = static_cast<int32_t>(markers.size());
+    const size_t length = format.row_bytes(m_header.width) + 1;
+    std::vector<uint32_t> checksums(count);
+    std::vector<std::exception_ptr> errors(count);
+    parallel_bands(count, [&](const int32_t begin, const int32_t end) {
+        PngPixelFormat band_format = format;
+        const std::vector<uint8_t> zeros(length);
+        for (int32_t band = begin; band < end; ++band) {
+            try {
+                const bool last = band + 1 == count;
+                const uint32_t first_row = markers[band].row;
+                const uint32_t end_row = last ? m_header.height : markers[band + 1].row;
+                const size_t input_end = last ? stream.size() - 4 : markers[band + 1].offset;
+                std::vector<uint8_t> scanlines = inflate_raw(stream.data() + markers[band].offset,
+                    input_end - markers[band].offset, (end_row - first_row) * length, m_checksum_policy,
+                    checksums[band]);
+                for (uint32_t row = first_row; row < end_row; ++row) {
+                    uint8_t* current = scanlines.data() + (row - first_row) * length;
+                    if (row == first_row && 1 < current[0])
+                        throw std::exception();
+                    const uint8_t* previous = row == first_row ? zeros.data() : current - length;
+                    unfilter_row(current[0], current + 1, previous + 1, length - 1, format.bytes_per_pixel());
+                    expand_row(band_format, static_cast<int32_t>(row), current + 1);
+                }
+            } catch (...) {
+                errors[band] = std::current_exception();
             }
-    return result;
+        }
+    }, 1);
+    for (const std::exception_ptr& error : errors)
+        if (error)
+            return false;
+    if (m_checksum_policy == ChecksumPolicy::Skip)
+        return true;
+    uint32_t adler = 1;
+    for (int32_t band = 0; band < count; ++band) {
+        const uint32_t end_row = band + 1 == count ? m_header.height : markers[band + 1].row;
+        adler = adler32_combine(adler, checksums[band], (end_row - markers[band].row) * length);
+    }
+    return adler == get_uint32_t_from_data(stream.data(), static_cast<int32_t>(stream.size() - 4));
 }
 
-std::vector<uint8_t> ReadPNG::deflate(const std::vector<uint8_t>& compressed_data) const
+// Expands one unfiltered scanline of a non-interlaced image into its row of m_image, and of m_image_rgba when the
+// image has alpha.
+void ReadPNG::expand_row(PngPixelFormat& format, const int32_t row, const uint8_t* bytes)
 {
-    std::vector<uint8_t> picture(m_header.height * m_header.width * 3 + m_header.height);
-
-    return picture;
+    const int32_t width = m_header.width;
+    auto* rgb = reinterpret_cast<uint8_t*>(m_image[row]);
+    if (!format.has_alpha()) {
+        format.expand_rgb(bytes, width, rgb);
+        return;
+    }
+    auto* rgba = reinterpret_cast<uint8_t*>(m_image_rgba[row]);
+    format.expand_rgba(bytes, width, rgba);
+    rgba_to_rgb(rgba, width, rgb);
 }
 
-static uint32_t get_uint32_t_from_data(const std::vector<uint8_t>& data, int32_t posistion)
+static uint32_t get_uint32_t_from_data(const uint8_t* data, const int32_t posistion)
 {
     uint32_t result = 0;
     for (uint32_t i = 0; i < 4; ++i)
-        result += data[i + posistion] * std::pow(256, 3 - i);
+        result = result << 8 | data[i + posistion];
     return result;
 }
 
@@ -186,7 +423,7 @@ std::ostream& operator<<(std::ostream& os, const IHDR& header)
     return os;
 }
 
-std::string get_chunk_name(const std::vector<uint8_t>& data)
+std::string get_chunk_name(const uint8_t* data)
 {
     std::string result;
     for (uint8_t i = 0; i < 4; ++i) {
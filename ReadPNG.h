@@ -3,11 +3,16 @@
 #ifndef READ_PNG_H
 #define READ_PNG_H
 
+#include "Image.h"
+#include "Image3x8.h"
+#include "checksum.h"
+#include "png_format.h"
+
 #include <cstdint>
 #include <ostream>
 #include <vector>
 
-static unsigned long crc_table[256];
+struct RestartMarker;
 
 struct Chunk {
     uint64_t length;
@@ -16,9 +21,6 @@ struct Chunk {
     uint8_t crc[4];
     Chunk();
     bool check_crc(uint32_t calculated_crc) const;
-    static unsigned long update_crc(uint32_t crc, const std::vector<uint8_t>& buffer);
-    static unsigned long get_crc(const std::vector<uint8_t>& buffer);
-    static void create_crc_table();
 };
 
 struct IHDR {
@@ -39,25 +41,38 @@ class ReadPNG {
     static const uint8_t s_signature[8];
     const char* c_path;
     std::vector<Chunk> m_chunks;
+    Image3x8 m_image;
+    Image<PixelRGBA8> m_image_rgba;
+    ChecksumPolicy m_checksum_policy;
+    bool m_checksums_valid;
 public:
-    explicit ReadPNG(const char* path);
+    explicit ReadPNG(const char* path, ChecksumPolicy checksum_policy = ChecksumPolicy::Verify);
 
     // ACCESSORS
     [[nodiscard]] const char* path() const { return c_path; }
     [[nodiscard]] int32_t width() const { return m_header.width; }
     [[nodiscard]] int32_t height() const { return  m_header.height; }
+    // Every color type and bit depth decodes to 8-bit RGB; an alpha channel or tRNS transparency is left out here
+    // and kept in image_rgba(), which is empty for opaque images.
+    [[nodiscard]] const Image3x8& image() const { return m_image; }
+    [[nodiscard]] const Image<PixelRGBA8>& image_rgba() const { return m_image_rgba; }
+    [[nodiscard]] bool has_alpha() const { return m_image_rgba.size() != 0; }
+    // False when a chunk CRC or the Adler-32 of the image data didn't match under ChecksumPolicy::Defer.
+    [[nodiscard]] bool checksums_valid() const { return m_checksums_valid; }
 private:
     static bool read_signature(std::ifstream& ifs);
-    std::vector<uint8_t> get_idat_data();
-    int32_t get_idat_data_length();
-    static bool read_chunk(std::ifstream& ifs, Chunk& chunk);
-    [[nodiscard]] std::vector<uint8_t> deflate(const std::vector<uint8_t>& compressed_data) const;
+    bool read_chunk(std::ifstream& ifs, Chunk& chunk);
+    void read_image_data(std::ifstream& ifs, Chunk& chunk, PngPixelFormat& format,
+        const std::vector<RestartMarker>& markers);
+    bool read_restart_bands(const std::vector<uint8_t>& stream, const PngPixelFormat& format,
+        const std::vector<RestartMarker>& markers);
+    void expand_row(PngPixelFormat& format, int32_t row, const uint8_t* bytes);
 };
 
-static uint32_t get_uint32_t_from_data(const std::vector<uint8_t>& data, int32_t posistion);
+static uint32_t get_uint32_t_from_data(const uint8_t* data, int32_t posistion);
 std::ostream& operator<<(std::ostream& os, const Chunk& chunk);
 std::ostream& operator<<(std::ostream& os, const ReadPNG& read_png);
 std::ostream& operator<<(std::ostream& os, const IHDR& header);
-std::string get_chunk_name(const std::vector<uint8_t>& data);
+std::string get_chunk_name(const uint8_t* data);
 
 #endif //READ_PNG_H
\ No newline at end of file
@@ -0,0 +1,124 @@
+#include "WritePNG.h"
+
+#include "checksum.h"
+#include "deflate.h"
+#include "parallel.h"
+#include "png_helpers.h"
+
+#include <algorithm>
+#include <cassert>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+static constexpr uint8_t s_signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+static constexpr size_t s_max_idat_size = 1 << 20;
+// Scanline bytes per restart band, rounded to whole rows.
+static constexpr size_t s_restart_band_size = 1 << 20;
+
+static void put_uint32(uint8_t* out, const uint32_t value)
+{
+    out[0] = static_cast<uint8_t>(value >> 24);
+    out[1] = static_cast<uint8_t>(value >> 16);
+    out[2] = static_cast<uint8_t>(value >> 8);
+    out[3] = static_cast<uint8_t>(value);
+}
+
+static void write_chunk(std::ofstream& ofs, const char* name, const uint8_t* data, const size_t size)
+{
+    uint8_t header[8];
+    put_uint32(header, static_cast<uint32_t>(size));
+    std::copy_n(name, 4, header + 4);
+    uint8_t crc[4];
+    put_uint32(crc, crc32(crc32(0, header + 4, 4), data, size));
+    ofs.write(reinterpret_cast<const char*>(header), 8);
+    ofs.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(size));
+    ofs.write(reinterpret_cast<const char*>(crc), 4);
+}
+
+// A zlib stream of bands of rows that are each filtered and deflated on their own, ending on a full flush, with
+// where every band starts.
+static std::vector<uint8_t> compress_restart_bands(const Image3x8& image, const PngWriteOptions& options,
+    std::vector<RestartMarker>& markers)
+{
+    const size_t length = static_cast<size_t>(image.width()) * 3 + 1;
+    const auto band_rows = static_cast<int32_t>(std::max<size_t>(1, s_restart_band_size / length));
+    const int32_t count = (image.height() + band_rows - 1) / band_rows;
+    std::vector<std::vector<uint8_t> > bands(count);
+    std::vector<uint32_t> checksums(count);
+    parallel_bands(count, [&](const int32_t begin, const int32_t end) {
+        std::vector<uint8_t> scanlines;
+        for (int32_t band = begin; band < end; ++band) {
+            const int32_t first = band * band_rows;
+            const int32_t last = std::min(image.height(), first + band_rows);
+            scanlines.resize((last - first) * length);
+            filter_rows(image, first, last, options.filter_type, true, scanlines.data());
+            deflate_raw(scanlines.data(), scanlines.size(), 0, options.compression_level, band == count - 1,
+                bands[band]);
+            checksums[band] = adler32(1, scanlines.data(), scanlines.size());
+        }
+    }, 1);
+
+    std::vector<uint8_t> out;
+    zlib_header(options.compression_level, out);
+    uint32_t adler = 1;
+    for (int32_t band = 0; band < count; ++band) {
+        markers.push_back({ static_cast<uint32_t>(band * band_rows), static_cast<uint32_t>(out.size()) });
+        out.insert(out.end(), bands[band].begin(), bands[band].end());
+        const int32_t rows = std::min(band_rows, image.height() - band * band_rows);
+        adler = adler32_combine(adler, checksums[band], rows * length);
+    }
+    for (int32_t shift = 24; 0 <= shift; shift -= 8)
+        out.push_back(static_cast<uint8_t>(adler >> shift));
+    // Offsets don't fit the chunk past 4 GiB; the file is then written without it.
+    if (UINT32_MAX < out.size())
+        markers.clear();
+    return out;
+}
+
+void write_png_file(const Image3x8& image, const char* path, const PngWriteOptions& options)
+{
+    assert(options.compression_level >= 0 && options.compression_level <= 9 && "out of range compression_level");
+    assert(options.filter_type >= -1 && options.filter_type <= 4 && "out of range filter_type");
+    std::ofstream ofs;
+    ofs.open(path, std::ios::out | std::ios::binary);
+    if (!ofs.is_open()) {
+        std::cout << "File could not be opened " << path << '\n';
+        throw std::exception();
+    }
+    ofs.write(reinterpret_cast<const char*>(s_signature), 8);
+    uint8_t header[13];
+    put_uint32(header, image.width());
+    put_uint32(header + 4, image.height());
+    header[8] = 8;
+    header[9] = 2;
+    header[10] = 0;
+    header[11] = 0;
+    header[12] = 0;
+    write_chunk(ofs, "IHDR", header, 13);
+    std::vector<uint8_t> compressed;
+    std::vector<RestartMarker> markers;
+    if (options.restart_markers) {
+        compressed = compress_restart_bands(image, options, markers);
+    } else {
+        const std::vector<uint8_t> scanlines = options.filter_type < 0
+            ? filter_adaptive(image)
+            : filter(image, static_cast<uint8_t>(options.filter_type));
+        compressed = zlib_compress(scanlines.data(), scanlines.size(), options.compression_level);
+    }
+    if (!markers.empty()) {
+        std::vector<uint8_t> restart(markers.size() * 8);
+        for (size_t i = 0; i < markers.size(); ++i) {
+            put_uint32(restart.data() + i * 8, markers[i].row);
+            put_uint32(restart.data() + i * 8 + 4, markers[i].offset);
+        }
+        write_chunk(ofs, "rsTR", restart.data(), restart.size());
+    }
+    for (size_t offset = 0; offset < compressed.size(); offset += s_max_idat_size)
+        write_chunk(ofs, "IDAT", compressed.data() + offset, std::min(s_max_idat_size, compressed.size() - offset));
+    write_chunk(ofs, "IEND", nullptr, 0);
+    if (!ofs) {
+        std::cout << "File could not be written " << path << '\n';
+        throw std::exception();
+    }
+}
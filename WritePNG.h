@@ -0,0 +1,23 @@
+#pragma once
+
+#ifndef WRITE_PNG_H
+#define WRITE_PNG_H
+
+#include "Image3x8.h"
+
+#include <cstdint>
+
+struct PngWriteOptions {
+    // 0 (stored) to 9 (smallest and slowest), as in zlib.
+    int32_t compression_level = 6;
+    // A filter type from 0 to 4 for every scanline, or -1 to choose one per scanline.
+    int32_t filter_type = -1;
+    // Compresses bands of rows independently and lists where they start in an rsTR chunk (see RestartMarker), so
+    // ReadPNG can decode the bands in parallel. Costs a little size.
+    bool restart_markers = true;
+};
+
+// Writes an 8-bit RGB PNG; throws std::exception when the file can't be written.
+void write_png_file(const Image3x8& image, const char* path, const PngWriteOptions& options = {});
+
+#endif //WRITE_PNG_H
@@ -0,0 +1,132 @@
+#include "alpha.h"
+
+#include "cpu_dispatch.h"
+#include "parallel.h"
+
+#include <algorithm>
+
+// x / 255 rounded to nearest for x <= 255 * 255, in 16 bit lanes.
+static uint16_t divide_255(const uint16_t x)
+{
+    const auto rounded = static_cast<uint16_t>(x + 128);
+    return static_cast<uint16_t>((rounded + (rounded >> 8)) >> 8);
+}
+
+SIMD_INLINE void premultiply_body(uint8_t* rgba, const size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        uint8_t* pixel = rgba + i * 4;
+        const uint16_t alpha = pixel[3];
+        for (int32_t channel = 0; channel < 3; ++channel)
+            pixel[channel] = static_cast<uint8_t>(divide_255(static_cast<uint16_t>(pixel[channel] * alpha)));
+    }
+}
+
+SIMD_INLINE void unpremultiply_body(uint8_t* rgba, const size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        uint8_t* pixel = rgba + i * 4;
+        const float scale = pixel[3] == 0 ? 0.0f : 255.0f / pixel[3];
+        for (int32_t channel = 0; channel < 3; ++channel)
+            pixel[channel] = static_cast<uint8_t>(std::min(pixel[channel] * scale + 0.5f, 255.0f));
+    }
+}
+
+SIMD_INLINE void composite_over_rgba_body(const uint8_t* src, uint8_t* dst, const size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        const auto keep = static_cast<uint16_t>(255 - src[i * 4 + 3]);
+        for (int32_t channel = 0; channel < 4; ++channel) {
+            const auto kept = static_cast<uint16_t>(dst[i * 4 + channel] * keep);
+            const auto value = static_cast<uint16_t>(src[i * 4 + channel] + divide_255(kept));
+            dst[i * 4 + channel] = static_cast<uint8_t>(std::min<uint16_t>(value, 255));
+        }
+    }
+}
+
+SIMD_INLINE void composite_over_rgb_body(const uint8_t* src, uint8_t* dst, const size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        const auto keep = static_cast<uint16_t>(255 - src[i * 4 + 3]);
+        for (int32_t channel = 0; channel < 3; ++channel) {
+            const auto kept = static_cast<uint16_t>(dst[i * 3 + channel] * keep);
+            const auto value = static_cast<uint16_t>(src[i * 4 + channel] + divide_255(kept));
+            dst[i * 3 + channel] = static_cast<uint8_t>(std::min<uint16_t>(value, 255));
+        }
+    }
+}
+
+SIMD_DISPATCH(void, premultiply_dispatch, premultiply_body, (uint8_t* rgba, const size_t count), (rgba, count))
+SIMD_DISPATCH(void, unpremultiply_dispatch, unpremultiply_body, (uint8_t* rgba, const size_t count), (rgba, count))
+SIMD_DISPATCH(void, composite_over_rgba_dispatch, composite_over_rgba_body, (const uint8_t* src, uint8_t* dst,
+    const size_t count), (src, dst, count))
+SIMD_DISPATCH(void, composite_over_rgb_dispatch, composite_over_rgb_body, (const uint8_t* src, uint8_t* dst,
+    const size_t count), (src, dst, count))
+
+void premultiply_alpha(uint8_t* rgba, const size_t count)
+{
+    premultiply_dispatch(rgba, count);
+}
+
+void unpremultiply_alpha(uint8_t* rgba, const size_t count)
+{
+    unpremultiply_dispatch(rgba, count);
+}
+
+void composite_over_rgba(const uint8_t* src, uint8_t* dst, const size_t count)
+{
+    composite_over_rgba_dispatch(src, dst, count);
+}
+
+void composite_over_rgb(const uint8_t* src, uint8_t* dst, const size_t count)
+{
+    composite_over_rgb_dispatch(src, dst, count);
+}
+
+void premultiply(Image<PixelRGBA8>& image)
+{
+    parallel_bands(image.height(), [&](const int32_t begin, const int32_t end) {
+        premultiply_alpha(image[begin]->samples, static_cast<size_t>(end - begin) * image.width());
+    });
+}
+
+void unpremultiply(Image<PixelRGBA8>& image)
+{
+    parallel_bands(image.height(), [&](const int32_t begin, const int32_t end) {
+        unpremultiply_alpha(image[begin]->samples, static_cast<size_t>(end - begin) * image.width());
+    });
+}
+
+// Calls blend(overlay_row, image_row, first_col, count) for every row of the overlay that lands on the image.
+template <typename Blend>
+static void for_each_overlap(const int32_t height, const int32_t width, const Image<PixelRGBA8>& overlay,
+    const int32_t top, const int32_t left, Blend&& blend)
+{
+    const int32_t first_row = std::max(top, 0);
+    const int32_t last_row = std::min(top + overlay.height(), height);
+    const int32_t first_col = std::max(left, 0);
+    const int32_t last_col = std::min(left + overlay.width(), width);
+    if (last_row <= first_row || last_col <= first_col)
+        return;
+    parallel_bands(last_row - first_row, [&](const int32_t begin, const int32_t end) {
+        for (int32_t row = first_row + begin; row < first_row + end; ++row)
+            blend(overlay[row - top] + (first_col - left), row, first_col, last_col - first_col);
+    });
+}
+
+void composite_over(Image<PixelRGBA8>& image, const Image<PixelRGBA8>& overlay, const int32_t top,
+    const int32_t left)
+{
+    for_each_overlap(image.height(), image.width(), overlay, top, left,
+        [&](const PixelRGBA8* src, const int32_t row, const int32_t col, const int32_t count) {
+            composite_over_rgba(src->samples, image[row][col].samples, count);
+        });
+}
+
+void composite_over(Image3x8& image, const Image<PixelRGBA8>& overlay, const int32_t top, const int32_t left)
+{
+    for_each_overlap(image.height(), image.width(), overlay, top, left,
+        [&](const PixelRGBA8* src, const int32_t row, const int32_t col, const int32_t count) {
+            composite_over_rgb(src->samples, reinterpret_cast<uint8_t*>(image[row] + col), count);
+        });
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#ifndef ALPHA_H
+#define ALPHA_H
+
+#include "Image.h"
+#include "Image3x8.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// Kernels over packed RGBA bytes with alpha last. Composited sources are premultiplied.
+void premultiply_alpha(uint8_t* rgba, size_t count);
+void unpremultiply_alpha(uint8_t* rgba, size_t count);
+// Porter-Duff source over destination: dst = src + dst * (1 - src alpha), on all four channels.
+void composite_over_rgba(const uint8_t* src, uint8_t* dst, size_t count);
+// The same onto an opaque RGB destination.
+void composite_over_rgb(const uint8_t* src, uint8_t* dst, size_t count);
+
+void premultiply(Image<PixelRGBA8>& image);
+void unpremultiply(Image<PixelRGBA8>& image);
+// Places the premultiplied overlay with its top left corner at (top, left) of the image; parts outside the image
+// are clipped.
+void composite_over(Image<PixelRGBA8>& image, const Image<PixelRGBA8>& overlay, int32_t top, int32_t left);
+void composite_over(Image3x8& image, const Image<PixelRGBA8>& overlay, int32_t top, int32_t left);
+
+#endif //ALPHA_H
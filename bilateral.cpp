@@ -0,0 +1,164 @@
+#include "bilateral.h"
+
+#include "cpu_dispatch.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <vector>
+
+static constexpr int32_t grid_padding = 2;
+static constexpr int32_t max_cell_size = 4;
+
+struct Grid {
+    int32_t rows;
+    int32_t cols;
+    int32_t depth;
+    int32_t cell;
+    std::vector<float> data;
+
+    [[nodiscard]] size_t row_size() const { return static_cast<size_t>(cols) * depth * cell; }
+    [[nodiscard]] float* row(const int32_t index) { return data.data() + index * row_size(); }
+    [[nodiscard]] const float* row(const int32_t index) const { return data.data() + index * row_size(); }
+};
+
+static uint8_t guide(const uint8_t* pixel, const int32_t channels)
+{
+    if (channels == 1)
+        return pixel[0];
+    return static_cast<uint8_t>((54 * pixel[0] + 183 * pixel[1] + 19 * pixel[2] + 128) >> 8);
+}
+
+// [1 4 6 4 1] / 16 along one axis of the grid; neighbouring positions are `stride` floats apart and each one
+// covers `length` contiguous floats.
+SIMD_INLINE void blur_span_body(const float* src, float* dst, const int32_t count, const size_t stride,
+    const size_t length)
+{
+    for (int32_t position = 0; position < count; ++position) {
+        const float* center = src + position * stride;
+        float* out = dst + position * stride;
+        for (size_t i = 0; i < length; ++i)
+            out[i] = 6.0f * center[i];
+        for (int32_t offset = -2; offset <= 2; ++offset) {
+            if (offset == 0 || position + offset < 0 || count <= position + offset)
+                continue;
+            const float weight = (offset == -1 || offset == 1) ? 4.0f : 1.0f;
+            const float* neighbour = src + (position + offset) * stride;
+            for (size_t i = 0; i < length; ++i)
+                out[i] += weight * neighbour[i];
+        }
+        for (size_t i = 0; i < length; ++i)
+            out[i] *= 1.0f / 16.0f;
+    }
+}
+
+SIMD_DISPATCH(void, blur_span, blur_span_body, (const float* src, float* dst, const int32_t count,
+    const size_t stride, const size_t length), (src, dst, count, stride, length))
+
+static void blur_grid(Grid& grid)
+{
+    std::vector<float> temp(grid.data.size());
+    const size_t row_size = grid.row_size();
+    const size_t cell_size = static_cast<size_t>(grid.depth) * grid.cell;
+    // along the range axis, then the columns, then the rows
+    parallel_bands(grid.rows, [&](const int32_t begin, const int32_t end) {
+        for (int32_t row = begin; row < end; ++row)
+            for (int32_t col = 0; col < grid.cols; ++col) {
+                const size_t offset = row * row_size + col * cell_size;
+                blur_span(grid.data.data() + offset, temp.data() + offset, grid.depth, grid.cell, grid.cell);
+            }
+    }, 1);
+    parallel_bands(grid.rows, [&](const int32_t begin, const int32_t end) {
+        for (int32_t row = begin; row < end; ++row)
+            blur_span(temp.data() + row * row_size, grid.row(row), grid.cols, cell_size, cell_size);
+    }, 1);
+    parallel_bands(grid.cols, [&](const int32_t begin, const int32_t end) {
+        blur_span(grid.data.data() + begin * cell_size, temp.data() + begin * cell_size, grid.rows, row_size,
+            (end - begin) * cell_size);
+    }, 1);
+    grid.data.swap(temp);
+}
+
+void bilateral_filter(uint8_t* pixels, const int32_t height, const int32_t width, const int32_t channels,
+    const double sigma_spatial, const double sigma_range)
+{
+    if (sigma_spatial <= 0.0 || sigma_range <= 0.0)
+        throw std::exception();
+    if (channels != 1 && channels != 3)
+        throw std::exception();
+    const float scale_spatial = static_cast<float>(1.0 / std::max(sigma_spatial, 1.0));
+    const float scale_range = static_cast<float>(1.0 / sigma_range);
+    Grid grid;
+    grid.rows = static_cast<int32_t>((height - 1) * scale_spatial) + 1 + 2 * grid_padding;
+    grid.cols = static_cast<int32_t>((width - 1) * scale_spatial) + 1 + 2 * grid_padding;
+    grid.depth = static_cast<int32_t>(255 * scale_range) + 1 + 2 * grid_padding;
+    grid.cell = channels + 1;
+    grid.data.assign(grid.row_size() * grid.rows, 0.0f);
+    const size_t length = static_cast<size_t>(width) * channels;
+    const size_t cell_size = static_cast<size_t>(grid.depth) * grid.cell;
+    std::vector<int32_t> splat_cols(width);
+    std::vector<int32_t> slice_cols(width);
+    std::vector<float> slice_fractions(width);
+    for (int32_t col = 0; col < width; ++col) {
+        const float x = col * scale_spatial + grid_padding;
+        splat_cols[col] = static_cast<int32_t>(x + 0.5f);
+        slice_cols[col] = static_cast<int32_t>(x);
+        slice_fractions[col] = x - slice_cols[col];
+    }
+
+    // Bands own whole grid rows, so no two threads splat into the same cell.
+    parallel_bands(grid.rows, [&](const int32_t begin, const int32_t end) {
+        for (int32_t row = 0; row < height; ++row) {
+            const int32_t target = static_cast<int32_t>(row * scale_spatial + grid_padding + 0.5f);
+            if (target < begin || end <= target)
+                continue;
+            const uint8_t* src = pixels + row * length;
+            float* dst = grid.row(target);
+            for (int32_t col = 0; col < width; ++col) {
+                const uint8_t* pixel = src + col * channels;
+                const auto z = static_cast<int32_t>(guide(pixel, channels) * scale_range + grid_padding + 0.5f);
+                float* cell = dst + splat_cols[col] * cell_size + z * grid.cell;
+                for (int32_t channel = 0; channel < channels; ++channel)
+                    cell[channel] += pixel[channel];
+                cell[channels] += 1.0f;
+            }
+        }
+    }, 1);
+
+    blur_grid(grid);
+
+    parallel_bands(height, [&](const int32_t begin, const int32_t end) {
+        float values[max_cell_size];
+        for (int32_t row = begin; row < end; ++row) {
+            const float y = row * scale_spatial + grid_padding;
+            const int32_t y0 = static_cast<int32_t>(y);
+            const float fy = y - y0;
+            uint8_t* dst = pixels + row * length;
+            for (int32_t col = 0; col < width; ++col) {
+                uint8_t* pixel = dst + col * channels;
+                const float z = guide(pixel, channels) * scale_range + grid_padding;
+                const int32_t x0 = slice_cols[col];
+                const int32_t z0 = static_cast<int32_t>(z);
+                const float fx = slice_fractions[col];
+                const float fz = z - z0;
+                std::fill(values, values + grid.cell, 0.0f);
+                for (int32_t corner = 0; corner < 8; ++corner) {
+                    const int32_t dy = corner >> 2;
+                    const int32_t dx = (corner >> 1) & 1;
+                    const int32_t dz = corner & 1;
+                    const float weight = (dy ? fy : 1.0f - fy) * (dx ? fx : 1.0f - fx) * (dz ? fz : 1.0f - fz);
+                    const float* cell = grid.row(y0 + dy) + (x0 + dx) * cell_size + (z0 + dz) * grid.cell;
+                    for (int32_t channel = 0; channel <= channels; ++channel)
+                        values[channel] += weight * cell[channel];
+                }
+                if (values[channels] <= 0.0f)
+                    continue;
+                const float normalize = 1.0f / values[channels];
+                for (int32_t channel = 0; channel < channels; ++channel)
+                    pixel[channel] = static_cast<uint8_t>(std::clamp(values[channel] * normalize + 0.5f, 0.0f,
+                        255.0f));
+            }
+        }
+    });
+}
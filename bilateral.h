@@ -0,0 +1,13 @@
+#pragma once
+
+#ifndef BILATERAL_H
+#define BILATERAL_H
+
+#include <cstdint>
+
+// Bilateral grid approximation (Chen, Paris and Durand): splat into a grid of sigma sized cells, blur the grid,
+// slice it back with trilinear interpolation. Colour images are guided by their luminance.
+void bilateral_filter(uint8_t* pixels, int32_t height, int32_t width, int32_t channels, double sigma_spatial,
+    double sigma_range);
+
+#endif //BILATERAL_H
@@ -0,0 +1,221 @@
+#include "checksum.h"
+
+#include "cpu_dispatch.h"
+
+#include <algorithm>
+#include <array>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define CHECKSUM_X86
+#endif
+
+using CrcTables = std::array<std::array<uint32_t, 256>, 16>;
+
+// tables[0] is the byte at a time table; tables[k] advances a byte through k more zero bytes, so 16 bytes are
+// folded in with 16 independent lookups.
+static constexpr CrcTables make_crc_tables()
+{
+    CrcTables tables = {};
+    for (uint32_t byte = 0; byte < 256; ++byte) {
+        uint32_t crc = byte;
+        for (int32_t bit = 0; bit < 8; ++bit)
+            crc = crc & 1 ? 0xedb88320 ^ crc >> 1 : crc >> 1;
+        tables[0][byte] = crc;
+    }
+    for (size_t k = 1; k < tables.size(); ++k)
+        for (uint32_t byte = 0; byte < 256; ++byte)
+            tables[k][byte] = tables[k - 1][byte] >> 8 ^ tables[0][tables[k - 1][byte] & 0xff];
+    return tables;
+}
+
+static constexpr CrcTables s_crc_tables = make_crc_tables();
+
+// Works on the inverted CRC, like the byte at a time loop.
+static uint32_t crc32_slicing(uint32_t state, const uint8_t* data, size_t size)
+{
+    const CrcTables& t = s_crc_tables;
+    for (; 16 <= size; data += 16, size -= 16) {
+        state ^= data[0] | data[1] << 8 | data[2] << 16 | static_cast<uint32_t>(data[3]) << 24;
+        state = t[15][state & 0xff] ^ t[14][state >> 8 & 0xff] ^ t[13][state >> 16 & 0xff] ^ t[12][state >> 24]
+            ^ t[11][data[4]] ^ t[10][data[5]] ^ t[9][data[6]] ^ t[8][data[7]]
+            ^ t[7][data[8]] ^ t[6][data[9]] ^ t[5][data[10]] ^ t[4][data[11]]
+            ^ t[3][data[12]] ^ t[2][data[13]] ^ t[1][data[14]] ^ t[0][data[15]];
+    }
+    for (size_t i = 0; i < size; ++i)
+        state = t[0][(state ^ data[i]) & 0xff] ^ state >> 8;
+    return state;
+}
+
+#ifdef CHECKSUM_X86
+SIMD_INLINE SIMD_TARGET_PCLMUL __m128i fold_crc(const __m128i value, const __m128i constants)
+{
+    return _mm_xor_si128(_mm_clmulepi64_si128(value, constants, 0x00),
+        _mm_clmulepi64_si128(value, constants, 0x11));
+}
+
+// Folds four 128 bit lanes across the data with carry-less multiplies, then reduces them to one lane, to 32 bits
+// and with a Barrett reduction to the CRC. The constants are x^n mod P for the folding distances, as in Intel's
+// "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ" and Linux's crc32-pclmul.
+SIMD_TARGET_PCLMUL static uint32_t crc32_pclmul(uint32_t state, const uint8_t* data, size_t size)
+{
+    if (size < 64)
+        return crc32_slicing(state, data, size);
+    const __m128i r2r1 = _mm_set_epi64x(0x1c6e41596, 0x154442bd4);
+    const __m128i r4r3 = _mm_set_epi64x(0xccaa009e, 0x1751997d0);
+    const __m128i r5 = _mm_set_epi64x(0, 0x163cd6124);
+    const __m128i ru_poly = _mm_set_epi64x(0x1f7011641, 0x1db710641);
+    const __m128i mask32 = _mm_set_epi32(0, 0, 0, -1);
+    auto load = [](const uint8_t* bytes) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes)); };
+    __m128i x1 = _mm_xor_si128(load(data), _mm_cvtsi32_si128(static_cast<int32_t>(state)));
+    __m128i x2 = load(data + 16);
+    __m128i x3 = load(data + 32);
+    __m128i x4 = load(data + 48);
+    data += 64;
+    size -= 64;
+    for (; 64 <= size; data += 64, size -= 64) {
+        x1 = _mm_xor_si128(fold_crc(x1, r2r1), load(data));
+        x2 = _mm_xor_si128(fold_crc(x2, r2r1), load(data + 16));
+        x3 = _mm_xor_si128(fold_crc(x3, r2r1), load(data + 32));
+        x4 = _mm_xor_si128(fold_crc(x4, r2r1), load(data + 48));
+    }
+    x1 = _mm_xor_si128(fold_crc(x1, r4r3), x2);
+    x1 = _mm_xor_si128(fold_crc(x1, r4r3), x3);
+    x1 = _mm_xor_si128(fold_crc(x1, r4r3), x4);
+    for (; 16 <= size; data += 16, size -= 16)
+        x1 = _mm_xor_si128(fold_crc(x1, r4r3), load(data));
+    x1 = _mm_xor_si128(_mm_clmulepi64_si128(x1, r4r3, 0x10), _mm_srli_si128(x1, 8));
+    x1 = _mm_xor_si128(_mm_clmulepi64_si128(_mm_and_si128(x1, mask32), r5, 0x00), _mm_srli_si128(x1, 4));
+    __m128i quotient = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), ru_poly, 0x10);
+    quotient = _mm_clmulepi64_si128(_mm_and_si128(quotient, mask32), ru_poly, 0x00);
+    state = static_cast<uint32_t>(_mm_extract_epi32(_mm_xor_si128(x1, quotient), 1));
+    return crc32_slicing(state, data, size);
+}
+#endif
+
+uint32_t crc32(const uint32_t crc, const uint8_t* data, const size_t size)
+{
+#ifdef CHECKSUM_X86
+    static const auto update = carryless_multiply_supported() ? crc32_pclmul : crc32_slicing;
+#else
+    static const auto update = crc32_slicing;
+#endif
+    return ~update(~crc, data, size);
+}
+
+static constexpr uint32_t s_adler_modulus = 65521;
+// Largest block whose sums can't overflow 32 bits before they are reduced.
+static constexpr size_t s_adler_block = 5552;
+
+static uint32_t adler32_scalar(const uint32_t adler, const uint8_t* data, size_t size)
+{
+    uint32_t a = adler & 0xffff;
+    uint32_t b = adler >> 16;
+    while (size != 0) {
+        const size_t length = std::min(size, s_adler_block);
+        for (size_t i = 0; i < length; ++i) {
+            a += data[i];
+            b += a;
+        }
+        a %= s_adler_modulus;
+        b %= s_adler_modulus;
+        data += length;
+        size -= length;
+    }
+    return b << 16 | a;
+}
+
+#ifdef CHECKSUM_X86
+// Over a run of n vectors, a grows by the byte sums (psadbw against zero) and b by n * a, by the byte sums of
+// every vector times the number of vectors after it (`prefix`, scaled by the vector width at the end) and by
+// each byte times its distance from the end of its vector (pmaddubsw with descending weights).
+SIMD_TARGET_SSE41 static uint32_t adler32_sse41(const uint32_t adler, const uint8_t* data, size_t size)
+{
+    constexpr size_t width = 16;
+    const __m128i weights = _mm_setr_epi8(16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+    const __m128i ones = _mm_set1_epi16(1);
+    const __m128i zero = _mm_setzero_si128();
+    auto sum = [](const __m128i value) SIMD_TARGET_SSE41 {
+        const __m128i pairs = _mm_add_epi32(value, _mm_shuffle_epi32(value, 0x4e));
+        return static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_add_epi32(pairs, _mm_shuffle_epi32(pairs, 0xb1))));
+    };
+    uint32_t a = adler & 0xffff;
+    uint32_t b = adler >> 16;
+    while (width <= size) {
+        const size_t length = std::min(size, s_adler_block) / width * width;
+        __m128i sum_a = zero;
+        __m128i sum_b = zero;
+        __m128i prefix = zero;
+        for (size_t i = 0; i < length; i += width) {
+            const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            prefix = _mm_add_epi32(prefix, sum_a);
+            sum_a = _mm_add_epi32(sum_a, _mm_sad_epu8(bytes, zero));
+            sum_b = _mm_add_epi32(sum_b, _mm_madd_epi16(_mm_maddubs_epi16(bytes, weights), ones));
+        }
+        b += a * static_cast<uint32_t>(length) + sum(prefix) * width + sum(sum_b);
+        a += sum(sum_a);
+        a %= s_adler_modulus;
+        b %= s_adler_modulus;
+        data += length;
+        size -= length;
+    }
+    return adler32_scalar(b << 16 | a, data, size);
+}
+
+SIMD_TARGET_AVX2 static uint32_t adler32_avx2(const uint32_t adler, const uint8_t* data, size_t size)
+{
+    constexpr size_t width = 32;
+    const __m256i weights = _mm256_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17, 16,
+        15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+    const __m256i ones = _mm256_set1_epi16(1);
+    const __m256i zero = _mm256_setzero_si256();
+    auto sum = [](const __m256i value) SIMD_TARGET_AVX2 {
+        const __m128i half = _mm_add_epi32(_mm256_castsi256_si128(value), _mm256_extracti128_si256(value, 1));
+        const __m128i pairs = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0x4e));
+        return static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_add_epi32(pairs, _mm_shuffle_epi32(pairs, 0xb1))));
+    };
+    uint32_t a = adler & 0xffff;
+    uint32_t b = adler >> 16;
+    while (width <= size) {
+        const size_t length = std::min(size, s_adler_block) / width * width;
+        __m256i sum_a = zero;
+        __m256i sum_b = zero;
+        __m256i prefix = zero;
+        for (size_t i = 0; i < length; i += width) {
+            const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+            prefix = _mm256_add_epi32(prefix, sum_a);
+            sum_a = _mm256_add_epi32(sum_a, _mm256_sad_epu8(bytes, zero));
+            sum_b = _mm256_add_epi32(sum_b, _mm256_madd_epi16(_mm256_maddubs_epi16(bytes, weights), ones));
+        }
+        b += a * static_cast<uint32_t>(length) + sum(prefix) * width + sum(sum_b);
+        a += sum(sum_a);
+        a %= s_adler_modulus;
+        b %= s_adler_modulus;
+        data += length;
+        size -= length;
+    }
+    return adler32_scalar(b << 16 | a, data, size);
+}
+#endif
+
+uint32_t adler32(const uint32_t adler, const uint8_t* data, const size_t size)
+{
+#ifdef CHECKSUM_X86
+    static const auto update = select_simd(adler32_scalar, adler32_sse41, adler32_avx2, adler32_avx2);
+#else
+    static const auto update = adler32_scalar;
+#endif
+    return update(adler, data, size);
+}
+
+// Every byte of the first piece is counted into b once more for each byte of the second, so b grows by that many
+// times the first a; the second a carries an extra 1 that is taken out.
+uint32_t adler32_combine(const uint32_t first, const uint32_t second, const size_t second_size)
+{
+    const uint64_t remainder = second_size % s_adler_modulus;
+    const uint64_t first_a = first & 0xFFFF;
+    const uint64_t a = (first_a + (second & 0xFFFF) + s_adler_modulus - 1) % s_adler_modulus;
+    const uint64_t b = ((first >> 16) + (second >> 16) + remainder * first_a + s_adler_modulus - remainder)
+        % s_adler_modulus;
+    return static_cast<uint32_t>(b << 16 | a);
+}
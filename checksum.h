@@ -0,0 +1,25 @@
+#pragma once
+
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <cstddef>
+#include <cstdint>
+
+// What a decoder does with the checksums in its input: Verify throws on a mismatch, Defer only records it for the
+// caller to look at once decoding is done, and Skip doesn't compute them, for input that is already trusted.
+enum class ChecksumPolicy : uint8_t {
+    Verify,
+    Defer,
+    Skip
+};
+
+// CRC-32 of PNG chunks, zlib and gzip (reflected polynomial 0xedb88320); start from 0 and pass the previous value
+// to continue over more data.
+uint32_t crc32(uint32_t crc, const uint8_t* data, size_t size);
+// Adler-32 of zlib streams (RFC 1950); start from 1 and pass the previous value to continue over more data.
+uint32_t adler32(uint32_t adler, const uint8_t* data, size_t size);
+// The Adler-32 of two pieces of data one after the other, from the checksum of each and the size of the second.
+uint32_t adler32_combine(uint32_t first, uint32_t second, size_t second_size);
+
+#endif //CHECKSUM_H
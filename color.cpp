@@ -0,0 +1,467 @@
+#include "color.h"
+
+#include "cpu_dispatch.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+static constexpr int32_t fixed_bits = 16;
+static constexpr int32_t fixed_half = 1 << (fixed_bits - 1);
+
+struct YCbCrCoefficients {
+    int32_t y_r;
+    int32_t y_g;
+    int32_t y_b;
+    int32_t cb_r;
+    int32_t cb_g;
+    int32_t cr_g;
+    int32_t cr_b;
+    int32_t r_cr;
+    int32_t g_cb;
+    int32_t g_cr;
+    int32_t b_cb;
+};
+
+static constexpr int32_t to_fixed(const double value)
+{
+    return static_cast<int32_t>(value * (1 << fixed_bits) + (value < 0 ? -0.5 : 0.5));
+}
+
+// Luma weights sum to exactly one and chroma weights to exactly zero, so greys stay grey. The chroma weight of
+// the matching primary is always one half.
+static constexpr YCbCrCoefficients make_coefficients(const double k_r, const double k_b)
+{
+    const double k_g = 1.0 - k_r - k_b;
+    YCbCrCoefficients result{};
+    result.y_r = to_fixed(k_r);
+    result.y_b = to_fixed(k_b);
+    result.y_g = (1 << fixed_bits) - result.y_r - result.y_b;
+    result.cb_r = to_fixed(-k_r / (2.0 * (1.0 - k_b)));
+    result.cb_g = -fixed_half - result.cb_r;
+    result.cr_b = to_fixed(-k_b / (2.0 * (1.0 - k_r)));
+    result.cr_g = -fixed_half - result.cr_b;
+    result.r_cr = to_fixed(2.0 * (1.0 - k_r));
+    result.g_cb = to_fixed(2.0 * k_b * (1.0 - k_b) / k_g);
+    result.g_cr = to_fixed(2.0 * k_r * (1.0 - k_r) / k_g);
+    result.b_cb = to_fixed(2.0 * (1.0 - k_b));
+    return result;
+}
+
+static constexpr YCbCrCoefficients bt601 = make_coefficients(0.299, 0.114);
+static constexpr YCbCrCoefficients bt709 = make_coefficients(0.2126, 0.0722);
+
+static const YCbCrCoefficients& coefficients(const YCbCrMatrix matrix)
+{
+    return matrix == YCbCrMatrix::Bt601 ? bt601 : bt709;
+}
+
+static uint8_t clamp_byte(const int32_t value)
+{
+    return static_cast<uint8_t>(std::clamp(value, 0, 255));
+}
+
+SIMD_INLINE void rgb_to_luma_body(const uint8_t* rgb, uint8_t* luma, const size_t count,
+    const YCbCrCoefficients& c)
+{
+    const int32_t y_r = c.y_r;
+    const int32_t y_g = c.y_g;
+    const int32_t y_b = c.y_b;
+    for (size_t i = 0; i < count; ++i)
+        luma[i] = static_cast<uint8_t>((y_r * rgb[i * 3] + y_g * rgb[i * 3 + 1] + y_b * rgb[i * 3 + 2] + fixed_half)
+            >> fixed_bits);
+}
+
+SIMD_INLINE void rgb_to_ycbcr_body(const uint8_t* rgb, uint8_t* luma, uint8_t* cb, uint8_t* cr, const size_t count,
+    const YCbCrCoefficients& c)
+{
+    const YCbCrCoefficients k = c;
+    constexpr int32_t offset = (128 << fixed_bits) + fixed_half;
+    for (size_t i = 0; i < count; ++i) {
+        const int32_t r = rgb[i * 3];
+        const int32_t g = rgb[i * 3 + 1];
+        const int32_t b = rgb[i * 3 + 2];
+        luma[i] = static_cast<uint8_t>((k.y_r * r + k.y_g * g + k.y_b * b + fixed_half) >> fixed_bits);
+        cb[i] = clamp_byte((k.cb_r * r + k.cb_g * g + fixed_half * b + offset) >> fixed_bits);
+        cr[i] = clamp_byte((fixed_half * r + k.cr_g * g + k.cr_b * b + offset) >> fixed_bits);
+    }
+}
+
+SIMD_INLINE void ycbcr_to_rgb_body(const uint8_t* luma, const uint8_t* cb, const uint8_t* cr, uint8_t* rgb,
+    const size_t count, const YCbCrCoefficients& c)
+{
+    const YCbCrCoefficients k = c;
+    constexpr int32_t offset = fixed_half;
+    for (size_t i = 0; i < count; ++i) {
+        const int32_t y = luma[i] << fixed_bits;
+        const int32_t u = cb[i] - 128;
+        const int32_t v = cr[i] - 128;
+        rgb[i * 3] = clamp_byte((y + k.r_cr * v + offset) >> fixed_bits);
+        rgb[i * 3 + 1] = clamp_byte((y - k.g_cb * u - k.g_cr * v + offset) >> fixed_bits);
+        rgb[i * 3 + 2] = clamp_byte((y + k.b_cb * u + offset) >> fixed_bits);
+    }
+}
+
+// Branch free so the compiler can vectorize it: the hue sector is picked with selects rather than jumps, and the
+// divisors are held at one or more, which only matters where their numerators are zero anyway.
+SIMD_INLINE void rgb_to_hsv_body(const uint8_t* rgb, float* hsv, const size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        const float r = rgb[i * 3];
+        const float g = rgb[i * 3 + 1];
+        const float b = rgb[i * 3 + 2];
+        const float high = std::max(r, std::max(g, b));
+        const float low = std::min(r, std::min(g, b));
+        const float delta = high - low;
+        const float inverse = 60.0f / std::max(delta, 1.0f);
+        float hue = high == r ? (g - b) * inverse : high == g ? (b - r) * inverse + 120.0f
+            : (r - g) * inverse + 240.0f;
+        hue = hue < 0.0f ? hue + 360.0f : hue;
+        hsv[i * 3] = hue;
+        hsv[i * 3 + 1] = delta / std::max(high, 1.0f);
+        hsv[i * 3 + 2] = high * (1.0f / 255.0f);
+    }
+}
+
+// c = v - v * s * clamp(min(k, 4 - k), 0, 1) with k = (n + hue / 60) mod 6 and n = 5, 3, 1 for red, green, blue.
+// The modulo truncates through int32_t and the result is stored through int32_t, both of which vectorize where
+// std::floor and a direct float to byte conversion don't.
+static uint8_t hsv_channel(const float n, const float sector, const float value, const float chroma)
+{
+    float k = n + sector;
+    k -= 6.0f * static_cast<float>(static_cast<int32_t>(k * (1.0f / 6.0f)));
+    k = k < 0.0f ? k + 6.0f : k;
+    const float ramp = std::min(std::max(std::min(k, 4.0f - k), 0.0f), 1.0f);
+    return static_cast<uint8_t>(static_cast<int32_t>(value - chroma * ramp + 0.5f));
+}
+
+SIMD_INLINE void hsv_to_rgb_body(const float* hsv, uint8_t* rgb, const size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        const float sector = hsv[i * 3] * (1.0f / 60.0f);
+        const float saturation = std::min(std::max(hsv[i * 3 + 1], 0.0f), 1.0f);
+        const float value = std::min(std::max(hsv[i * 3 + 2], 0.0f), 1.0f) * 255.0f;
+        const float chroma = value * saturation;
+        rgb[i * 3] = hsv_channel(5.0f, sector, value, chroma);
+        rgb[i * 3 + 1] = hsv_channel(3.0f, sector, value, chroma);
+        rgb[i * 3 + 2] = hsv_channel(1.0f, sector, value, chroma);
+    }
+}
+
+static double srgb_decode(const double value)
+{
+    return value <= 0.04045 ? value / 12.92 : std::pow((value + 0.055) / 1.055, 2.4);
+}
+
+struct SrgbTables {
+    static constexpr int32_t s_cells = 4096;
+    std::array<float, 256> decode;
+    // Linear value halfway between a code and the next one; the last entry can never be reached.
+    std::array<float, 256> thresholds;
+    // Code of the start of each cell, a little below it so float rounding of the cell index can't overshoot.
+    std::array<uint8_t, s_cells> coarse;
+    // The same for 16 bit linear light, where a cell is 16 values wide: the smallest value of each code and the
+    // code of every cell start, both exact.
+    std::array<uint16_t, 256> decode16;
+    std::array<int32_t, 256> thresholds16;
+    std::array<uint8_t, s_cells> coarse16;
+
+    SrgbTables()
+        : decode(), thresholds(), coarse(), decode16(), thresholds16(), coarse16()
+    {
+        for (int32_t code = 0; code < 256; ++code) {
+            const double middle = srgb_decode((code + 0.5) / 255.0);
+            decode[code] = static_cast<float>(srgb_decode(code / 255.0));
+            decode16[code] = static_cast<uint16_t>(std::lround(srgb_decode(code / 255.0) * 65535.0));
+            thresholds[code] = code == 255 ? 2.0f : static_cast<float>(middle);
+            thresholds16[code] = code == 255 ? 65536 : static_cast<int32_t>(std::ceil(middle * 65535.0));
+        }
+        int32_t code = 0;
+        int32_t code16 = 0;
+        for (int32_t cell = 0; cell < s_cells; ++cell) {
+            const float start = static_cast<float>(cell) / (s_cells - 1) - 1e-7f;
+            while (thresholds[code] <= start)
+                ++code;
+            while (thresholds16[code16] <= cell << 4)
+                ++code16;
+            coarse[cell] = static_cast<uint8_t>(code);
+            coarse16[cell] = static_cast<uint8_t>(code16);
+        }
+    }
+};
+
+static const SrgbTables& srgb_tables()
+{
+    static const SrgbTables tables;
+    return tables;
+}
+
+void srgb_to_linear(const uint8_t* srgb, float* linear, const size_t count)
+{
+    const std::array<float, 256>& decode = srgb_tables().decode;
+    for (size_t i = 0; i < count; ++i)
+        linear[i] = decode[srgb[i]];
+}
+
+// Codes are at least 1 / (255 * 12.92) apart in linear light, wider than a cell, so at most one threshold falls
+// inside a cell and one comparison corrects the coarse code.
+void linear_to_srgb(const float* linear, uint8_t* srgb, const size_t count)
+{
+    const SrgbTables& tables = srgb_tables();
+    for (size_t i = 0; i < count; ++i) {
+        const float value = std::clamp(linear[i], 0.0f, 1.0f);
+        const uint8_t code = tables.coarse[static_cast<int32_t>(value * (SrgbTables::s_cells - 1))];
+        srgb[i] = static_cast<uint8_t>(code + (tables.thresholds[code] <= value ? 1 : 0));
+    }
+}
+
+void srgb_to_linear16(const uint8_t* srgb, uint16_t* linear, const size_t count)
+{
+    const std::array<uint16_t, 256>& decode = srgb_tables().decode16;
+    for (size_t i = 0; i < count; ++i)
+        linear[i] = decode[srgb[i]];
+}
+
+// Codes are at least 65535 / (255 * 12.92) > 19 values apart, so a 16 wide cell holds at most one threshold.
+static uint8_t encode_linear16(const SrgbTables& tables, const int32_t value)
+{
+    const uint8_t code = tables.coarse16[value >> 4];
+    return static_cast<uint8_t>(code + (tables.thresholds16[code] <= value ? 1 : 0));
+}
+
+void linear16_to_srgb(const uint16_t* linear, uint8_t* srgb, const size_t count)
+{
+    const SrgbTables& tables = srgb_tables();
+    for (size_t i = 0; i < count; ++i)
+        srgb[i] = encode_linear16(tables, linear[i]);
+}
+
+static constexpr float lab_epsilon = 216.0f / 24389.0f;
+static constexpr float lab_kappa = 24389.0f / 27.0f;
+static constexpr float white_x = 0.95047f;
+static constexpr float white_z = 1.08883f;
+
+static float lab_f(const float t)
+{
+    return t > lab_epsilon ? std::cbrt(t) : (lab_kappa * t + 16.0f) / 116.0f;
+}
+
+static float lab_f_inverse(const float f)
+{
+    const float cube = f * f * f;
+    return cube > lab_epsilon ? cube : (116.0f * f - 16.0f) / lab_kappa;
+}
+
+void linear_to_lab(const float* rgb, float* lab, const size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        const float r = rgb[i * 3];
+        const float g = rgb[i * 3 + 1];
+        const float b = rgb[i * 3 + 2];
+        const float x = (0.4124564f * r + 0.3575761f * g + 0.1804375f * b) / white_x;
+        const float y = 0.2126729f * r + 0.7151522f * g + 0.0721750f * b;
+        const float z = (0.0193339f * r + 0.1191920f * g + 0.9503041f * b) / white_z;
+        const float f_y = lab_f(y);
+        lab[i * 3] = 116.0f * f_y - 16.0f;
+        lab[i * 3 + 1] = 500.0f * (lab_f(x) - f_y);
+        lab[i * 3 + 2] = 200.0f * (f_y - lab_f(z));
+    }
+}
+
+void lab_to_linear(const float* lab, float* rgb, const size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        const float f_y = (lab[i * 3] + 16.0f) / 116.0f;
+        const float x = lab_f_inverse(f_y + lab[i * 3 + 1] / 500.0f) * white_x;
+        const float y = lab_f_inverse(f_y);
+        const float z = lab_f_inverse(f_y - lab[i * 3 + 2] / 200.0f) * white_z;
+        rgb[i * 3] = 3.2404542f * x - 1.5371385f * y - 0.4985314f * z;
+        rgb[i * 3 + 1] = -0.9692660f * x + 1.8760108f * y + 0.0415560f * z;
+        rgb[i * 3 + 2] = 0.0556434f * x - 0.2040259f * y + 1.0572252f * z;
+    }
+}
+
+SIMD_DISPATCH(void, rgb_to_luma_rows, rgb_to_luma_body, (const uint8_t* rgb, uint8_t* luma, const size_t count,
+    const YCbCrCoefficients& c), (rgb, luma, count, c))
+SIMD_DISPATCH(void, rgb_to_ycbcr_rows, rgb_to_ycbcr_body, (const uint8_t* rgb, uint8_t* luma, uint8_t* cb,
+    uint8_t* cr, const size_t count, const YCbCrCoefficients& c), (rgb, luma, cb, cr, count, c))
+SIMD_DISPATCH(void, ycbcr_to_rgb_rows, ycbcr_to_rgb_body, (const uint8_t* luma, const uint8_t* cb,
+    const uint8_t* cr, uint8_t* rgb, const size_t count, const YCbCrCoefficients& c), (luma, cb, cr, rgb, count, c))
+SIMD_DISPATCH(void, rgb_to_hsv_rows, rgb_to_hsv_body, (const uint8_t* rgb, float* hsv, const size_t count),
+    (rgb, hsv, count))
+SIMD_DISPATCH(void, hsv_to_rgb_rows, hsv_to_rgb_body, (const float* hsv, uint8_t* rgb, const size_t count),
+    (hsv, rgb, count))
+
+void rgb_to_luma(const uint8_t* rgb, uint8_t* luma, const size_t count, const YCbCrMatrix matrix)
+{
+    rgb_to_luma_rows(rgb, luma, count, coefficients(matrix));
+}
+
+void rgb_to_ycbcr(const uint8_t* rgb, uint8_t* luma, uint8_t* cb, uint8_t* cr, const size_t count,
+    const YCbCrMatrix matrix)
+{
+    rgb_to_ycbcr_rows(rgb, luma, cb, cr, count, coefficients(matrix));
+}
+
+void ycbcr_to_rgb(const uint8_t* luma, const uint8_t* cb, const uint8_t* cr, uint8_t* rgb, const size_t count,
+    const YCbCrMatrix matrix)
+{
+    ycbcr_to_rgb_rows(luma, cb, cr, rgb, count, coefficients(matrix));
+}
+
+void rgb_to_hsv(const uint8_t* rgb, float* hsv, const size_t count)
+{
+    rgb_to_hsv_rows(rgb, hsv, count);
+}
+
+void hsv_to_rgb(const float* hsv, uint8_t* rgb, const size_t count)
+{
+    hsv_to_rgb_rows(hsv, rgb, count);
+}
+
+static const uint8_t* bytes(const Image3x8& image, const int32_t row)
+{
+    return reinterpret_cast<const uint8_t*>(image[row]);
+}
+
+static uint8_t* bytes(Image3x8& image, const int32_t row)
+{
+    return reinterpret_cast<uint8_t*>(image[row]);
+}
+
+// Runs convert(first_row, pixel_count) over bands of whole rows.
+template <typename Convert>
+static void convert_rows(const int32_t height, const int32_t width, Convert&& convert)
+{
+    parallel_bands(height, [&](const int32_t begin, const int32_t end) {
+        convert(begin, static_cast<size_t>(end - begin) * width);
+    });
+}
+
+YCbCrPlanes to_ycbcr(const Image3x8& image, const YCbCrMatrix matrix)
+{
+    YCbCrPlanes result{ ImageGray8(image.height(), image.width()), ImageGray8(image.height(), image.width()),
+        ImageGray8(image.height(), image.width()) };
+    convert_rows(image.height(), image.width(), [&](const int32_t row, const size_t count) {
+        rgb_to_ycbcr(bytes(image, row), result.luma[row], result.cb[row], result.cr[row], count, matrix);
+    });
+    return result;
+}
+
+Image3x8 from_ycbcr(const YCbCrPlanes& planes, const YCbCrMatrix matrix)
+{
+    Image3x8 result(planes.luma.height(), planes.luma.width());
+    convert_rows(result.height(), result.width(), [&](const int32_t row, const size_t count) {
+        ycbcr_to_rgb(planes.luma[row], planes.cb[row], planes.cr[row], bytes(result, row), count, matrix);
+    });
+    return result;
+}
+
+Image<PixelRGBF32> to_hsv(const Image3x8& image)
+{
+    Image<PixelRGBF32> result(image.height(), image.width());
+    convert_rows(image.height(), image.width(), [&](const int32_t row, const size_t count) {
+        rgb_to_hsv(bytes(image, row), result[row]->samples, count);
+    });
+    return result;
+}
+
+Image3x8 from_hsv(const Image<PixelRGBF32>& image)
+{
+    Image3x8 result(image.height(), image.width());
+    convert_rows(image.height(), image.width(), [&](const int32_t row, const size_t count) {
+        hsv_to_rgb(image[row]->samples, bytes(result, row), count);
+    });
+    return result;
+}
+
+Image<PixelRGBF32> to_linear(const Image3x8& image)
+{
+    Image<PixelRGBF32> result(image.height(), image.width());
+    convert_rows(image.height(), image.width(), [&](const int32_t row, const size_t count) {
+        srgb_to_linear(bytes(image, row), result[row]->samples, count * 3);
+    });
+    return result;
+}
+
+Image3x8 from_linear(const Image<PixelRGBF32>& image)
+{
+    Image3x8 result(image.height(), image.width());
+    convert_rows(image.height(), image.width(), [&](const int32_t row, const size_t count) {
+        linear_to_srgb(image[row]->samples, bytes(result, row), count * 3);
+    });
+    return result;
+}
+
+Image<PixelRGBF32> to_lab(const Image3x8& image)
+{
+    Image<PixelRGBF32> result = to_linear(image);
+    convert_rows(image.height(), image.width(), [&](const int32_t row, const size_t count) {
+        linear_to_lab(result[row]->samples, result[row]->samples, count);
+    });
+    return result;
+}
+
+Image3x8 from_lab(const Image<PixelRGBF32>& image)
+{
+    Image<PixelRGBF32> linear(image.height(), image.width());
+    convert_rows(image.height(), image.width(), [&](const int32_t row, const size_t count) {
+        lab_to_linear(image[row]->samples, linear[row]->samples, count);
+    });
+    return from_linear(linear);
+}
+
+// Full range chroma is unchanged by adding the same amount to red, green and blue, so only one of three planes is
+// filtered.
+void filter_luma(Image3x8& image, const std::function<void(ImageGray8&)>& filter)
+{
+    ImageGray8 luma(image.height(), image.width());
+    convert_rows(image.height(), image.width(), [&](const int32_t row, const size_t count) {
+        rgb_to_luma(bytes(image, row), luma[row], count, YCbCrMatrix::Bt709);
+    });
+    ImageGray8 filtered(luma);
+    filter(filtered);
+    convert_rows(image.height(), image.width(), [&](const int32_t row, const size_t count) {
+        uint8_t* pixels = bytes(image, row);
+        const uint8_t* before = luma[row];
+        const uint8_t* after = filtered[row];
+        for (size_t i = 0; i < count; ++i) {
+            const int32_t delta = after[i] - before[i];
+            for (int32_t channel = 0; channel < 3; ++channel)
+                pixels[i * 3 + channel] = clamp_byte(pixels[i * 3 + channel] + delta);
+        }
+    });
+}
+
+void hue_saturation_filter(uint8_t* rgb, const int32_t height, const int32_t width, const double hue_shift,
+    const double saturation)
+{
+    const auto shift = static_cast<float>(std::fmod(std::fmod(hue_shift, 360.0) + 360.0, 360.0));
+    const auto scale = static_cast<float>(saturation);
+    parallel_bands(height, [&](const int32_t begin, const int32_t end) {
+        std::vector<float> hsv(static_cast<size_t>(width) * 3);
+        for (int32_t row = begin; row < end; ++row) {
+            uint8_t* pixels = rgb + static_cast<size_t>(row) * width * 3;
+            rgb_to_hsv(pixels, hsv.data(), width);
+            for (int32_t col = 0; col < width; ++col) {
+                hsv[col * 3] += shift;
+                hsv[col * 3 + 1] *= scale;
+            }
+            hsv_to_rgb(hsv.data(), pixels, width);
+        }
+    });
+}
+
+// Decodes samples through the 16 bit table as the first pass loads them, and rounds to 16 bits and encodes as the
+// last one stores them, so no pass is added.
+void resize_linear_light(const uint8_t* src, const int32_t height, const int32_t width, uint8_t* dst,
+    const int32_t new_height, const int32_t new_width, const ResizeFilter filter)
+{
+    const SrgbTables& tables = srgb_tables();
+    resample_float<uint8_t, 3>(src, height, width, dst, new_height, new_width, filter,
+        [&tables](const uint8_t value) { return static_cast<float>(tables.decode16[value]); },
+        [&tables](const float value) {
+            return encode_linear16(tables, static_cast<int32_t>(std::min(std::max(value + 0.5f, 0.0f), 65535.0f)));
+        });
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#ifndef COLOR_H
+#define COLOR_H
+
+#include "Image.h"
+#include "Image3x8.h"
+#include "ImageGray8.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+// Full range YCbCr as in JPEG, chroma centred on 128.
+enum class YCbCrMatrix : uint8_t {
+    Bt601,
+    Bt709
+};
+
+// Kernels over `count` packed RGB pixels.
+void rgb_to_luma(const uint8_t* rgb, uint8_t* luma, size_t count, YCbCrMatrix matrix);
+void rgb_to_ycbcr(const uint8_t* rgb, uint8_t* luma, uint8_t* cb, uint8_t* cr, size_t count, YCbCrMatrix matrix);
+void ycbcr_to_rgb(const uint8_t* luma, const uint8_t* cb, const uint8_t* cr, uint8_t* rgb, size_t count,
+    YCbCrMatrix matrix);
+// Hue in degrees [0, 360), saturation and value in [0, 1].
+void rgb_to_hsv(const uint8_t* rgb, float* hsv, size_t count);
+void hsv_to_rgb(const float* hsv, uint8_t* rgb, size_t count);
+// Per sample; linear values are in [0, 1] and encoding rounds to the nearest sRGB code.
+void srgb_to_linear(const uint8_t* srgb, float* linear, size_t count);
+void linear_to_srgb(const float* linear, uint8_t* srgb, size_t count);
+// The same with linear light in 16 bits, full scale 65535.
+void srgb_to_linear16(const uint8_t* srgb, uint16_t* linear, size_t count);
+void linear16_to_srgb(const uint16_t* linear, uint8_t* srgb, size_t count);
+// CIE L*a*b* from linear sRGB under D65.
+void linear_to_lab(const float* rgb, float* lab, size_t count);
+void lab_to_linear(const float* lab, float* rgb, size_t count);
+
+struct YCbCrPlanes {
+    ImageGray8 luma;
+    ImageGray8 cb;
+    ImageGray8 cr;
+};
+
+YCbCrPlanes to_ycbcr(const Image3x8& image, YCbCrMatrix matrix);
+Image3x8 from_ycbcr(const YCbCrPlanes& planes, YCbCrMatrix matrix);
+// Samples are hue, saturation and value.
+Image<PixelRGBF32> to_hsv(const Image3x8& image);
+Image3x8 from_hsv(const Image<PixelRGBF32>& image);
+Image<PixelRGBF32> to_linear(const Image3x8& image);
+Image3x8 from_linear(const Image<PixelRGBF32>& image);
+// Samples are L*, a* and b*.
+Image<PixelRGBF32> to_lab(const Image3x8& image);
+Image3x8 from_lab(const Image<PixelRGBF32>& image);
+
+// Runs `filter` over the BT.709 luma plane of `image`, then moves every channel by the change in luma.
+void filter_luma(Image3x8& image, const std::function<void(ImageGray8&)>& filter);
+// Rotates hue by `hue_shift` degrees and scales saturation, in place over packed RGB rows.
+void hue_saturation_filter(uint8_t* rgb, int32_t height, int32_t width, double hue_shift, double saturation);
+// Resamples packed RGB rows in linear light.
+void resize_linear_light(const uint8_t* src, int32_t height, int32_t width, uint8_t* dst, int32_t new_height,
+    int32_t new_width, ResizeFilter filter);
+
+#endif //COLOR_H
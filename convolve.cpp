@@ -0,0 +1,324 @@
+#include "convolve.h"
+
+#include "cpu_dispatch.h"
+#include "fft.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <exception>
+
+struct SeparableKernel {
+    bool separable;
+    std::vector<float> horizontal;
+    std::vector<float> vertical;
+};
+
+// Rank one test through the leading singular pair of the kernel, found by power iteration on K^T K. The singular
+// value is split evenly between the two passes, so neither filter carries the whole gain.
+static SeparableKernel split_kernel(const std::vector<double>& kernel, const int32_t kernel_width,
+    const int32_t kernel_height)
+{
+    SeparableKernel result{ false, {}, {} };
+    double norm = 0;
+    for (const double weight : kernel)
+        norm += weight * weight;
+    if (norm == 0.0)
+        return result;
+    std::vector<double> v(kernel_width, 1.0 / std::sqrt(kernel_width));
+    std::vector<double> u(kernel_height);
+    double sigma = 0;
+    for (int32_t iteration = 0; iteration < 64; ++iteration) {
+        for (int32_t row = 0; row < kernel_height; ++row) {
+            u[row] = 0;
+            for (int32_t col = 0; col < kernel_width; ++col)
+                u[row] += kernel[row * kernel_width + col] * v[col];
+        }
+        double length = 0;
+        for (int32_t col = 0; col < kernel_width; ++col) {
+            v[col] = 0;
+            for (int32_t row = 0; row < kernel_height; ++row)
+                v[col] += kernel[row * kernel_width + col] * u[row];
+            length += v[col] * v[col];
+        }
+        length = std::sqrt(length);
+        if (length == 0.0)
+            return result;
+        for (double& value : v)
+            value /= length;
+    }
+    for (int32_t row = 0; row < kernel_height; ++row) {
+        u[row] = 0;
+        for (int32_t col = 0; col < kernel_width; ++col)
+            u[row] += kernel[row * kernel_width + col] * v[col];
+        sigma += u[row] * u[row];
+    }
+    sigma = std::sqrt(sigma);
+    if (sigma == 0.0)
+        return result;
+    double residual = 0;
+    for (int32_t row = 0; row < kernel_height; ++row)
+        for (int32_t col = 0; col < kernel_width; ++col) {
+            const double difference = kernel[row * kernel_width + col] - u[row] * v[col];
+            residual += difference * difference;
+        }
+    if (1e-10 * norm < residual)
+        return result;
+    const double scale = std::sqrt(sigma);
+    result.separable = true;
+    for (const double value : v)
+        result.horizontal.push_back(static_cast<float>(value * scale));
+    for (const double value : u)
+        result.vertical.push_back(static_cast<float>(value / scale));
+    return result;
+}
+
+// Estimated multiply-adds per output sample, so the three paths can be compared directly. The Fourier path
+// carries a factor for its strided column passes and complex arithmetic.
+static double fourier_cost(const int32_t size, const int32_t valid)
+{
+    constexpr double overhead = 3.0;
+    const double points = static_cast<double>(size) * size;
+    const double transforms = 4.0 * points * std::log2(points);
+    const double products = 4.0 * points;
+    return overhead * (transforms + products) / (2.0 * valid * valid);
+}
+
+static int32_t fourier_size(const int32_t kernel_width, const int32_t kernel_height, double& cost)
+{
+    const int32_t extent = std::max(kernel_width, kernel_height);
+    int32_t best_size = 0;
+    for (int32_t size = 32; size <= 1024; size *= 2) {
+        const int32_t valid = size - extent + 1;
+        if (valid < size / 4)
+            continue;
+        const double size_cost = fourier_cost(size, valid);
+        if (best_size == 0 || size_cost < cost) {
+            best_size = size;
+            cost = size_cost;
+        }
+    }
+    return best_size;
+}
+
+ConvolvePath choose_convolve_path(const std::vector<double>& kernel, const int32_t kernel_width,
+    const int32_t kernel_height)
+{
+    double fourier = 0;
+    const bool has_fourier = fourier_size(kernel_width, kernel_height, fourier) != 0;
+    const double direct = static_cast<double>(kernel_width) * kernel_height;
+    double best = direct;
+    ConvolvePath result = ConvolvePath::Direct;
+    if (1 < kernel_width && 1 < kernel_height && split_kernel(kernel, kernel_width, kernel_height).separable) {
+        best = kernel_width + kernel_height;
+        result = ConvolvePath::Separable;
+    }
+    if (has_fourier && fourier < best)
+        result = ConvolvePath::Fourier;
+    return result;
+}
+
+static uint8_t to_byte(const float value)
+{
+    return static_cast<uint8_t>(std::clamp(value + 0.5f, 0.0f, 255.0f));
+}
+
+SIMD_INLINE void add_scaled_row_body(float* sum, const float* src, const float weight, const size_t length)
+{
+    for (size_t i = 0; i < length; ++i)
+        sum[i] += weight * src[i];
+}
+
+SIMD_INLINE void store_row_body(const float* src, uint8_t* dst, const size_t length)
+{
+    for (size_t i = 0; i < length; ++i)
+        dst[i] = to_byte(src[i]);
+}
+
+SIMD_DISPATCH(void, add_scaled_row, add_scaled_row_body, (float* sum, const float* src, const float weight,
+    const size_t length), (sum, src, weight, length))
+SIMD_DISPATCH(void, store_row, store_row_body, (const float* src, uint8_t* dst, const size_t length),
+    (src, dst, length))
+
+// Source row converted to float with `left` and `right` replicated pixels on either side.
+static void load_padded_row(const uint8_t* src, float* dst, const int32_t width, const int32_t channels,
+    const int32_t left, const int32_t right)
+{
+    const size_t length = static_cast<size_t>(width) * channels;
+    for (int32_t col = 0; col < left; ++col)
+        for (int32_t channel = 0; channel < channels; ++channel)
+            dst[col * channels + channel] = src[channel];
+    float* middle = dst + left * channels;
+    for (size_t i = 0; i < length; ++i)
+        middle[i] = src[i];
+    for (int32_t col = 0; col < right; ++col)
+        for (int32_t channel = 0; channel < channels; ++channel)
+            middle[length + col * channels + channel] = src[length - channels + channel];
+}
+
+// Runs `produce(row)` for every output row of the band after the ring holds the `taps` source rows it needs;
+// `load(source_row, slot_data)` fills a ring slot.
+template <typename Load, typename Produce>
+static void ring_rows(const int32_t begin, const int32_t end, const int32_t height, const int32_t taps,
+    const int32_t anchor, std::vector<float>& ring, const size_t slot_size, Load&& load, Produce&& produce)
+{
+    auto slot = [taps](const int32_t row) { return ((row % taps) + taps) % taps; };
+    for (int32_t row = begin - anchor; row < begin - anchor + taps - 1; ++row)
+        load(std::clamp(row, 0, height - 1), &ring[slot(row) * slot_size]);
+    std::vector<const float*> rows(taps);
+    for (int32_t row = begin; row < end; ++row) {
+        const int32_t newest = row - anchor + taps - 1;
+        load(std::clamp(newest, 0, height - 1), &ring[slot(newest) * slot_size]);
+        for (int32_t tap = 0; tap < taps; ++tap)
+            rows[tap] = &ring[slot(row - anchor + tap) * slot_size];
+        produce(row, rows);
+    }
+}
+
+static void convolve_separable(const uint8_t* src, uint8_t* dst, const int32_t height, const int32_t width,
+    const int32_t channels, const SeparableKernel& kernel)
+{
+    const auto kernel_width = static_cast<int32_t>(kernel.horizontal.size());
+    const auto kernel_height = static_cast<int32_t>(kernel.vertical.size());
+    const int32_t anchor_x = kernel_width / 2;
+    const int32_t anchor_y = kernel_height / 2;
+    const size_t length = static_cast<size_t>(width) * channels;
+    parallel_bands(height, [&](const int32_t begin, const int32_t end) {
+        std::vector<float> padded((width + kernel_width - 1) * channels);
+        std::vector<float> ring(kernel_height * length);
+        std::vector<float> sum(length);
+        auto load = [&](const int32_t row, float* slot) {
+            load_padded_row(src + row * length, padded.data(), width, channels, anchor_x,
+                kernel_width - 1 - anchor_x);
+            std::fill(slot, slot + length, 0.0f);
+            for (int32_t tap = 0; tap < kernel_width; ++tap)
+                add_scaled_row(slot, padded.data() + tap * channels, kernel.horizontal[tap], length);
+        };
+        auto produce = [&](const int32_t row, const std::vector<const float*>& rows) {
+            std::fill(sum.begin(), sum.end(), 0.0f);
+            for (int32_t tap = 0; tap < kernel_height; ++tap)
+                add_scaled_row(sum.data(), rows[tap], kernel.vertical[tap], length);
+            store_row(sum.data(), dst + row * length, length);
+        };
+        ring_rows(begin, end, height, kernel_height, anchor_y, ring, length, load, produce);
+    });
+}
+
+static void convolve_direct(const uint8_t* src, uint8_t* dst, const int32_t height, const int32_t width,
+    const int32_t channels, const std::vector<double>& kernel, const int32_t kernel_width,
+    const int32_t kernel_height)
+{
+    const int32_t anchor_x = kernel_width / 2;
+    const int32_t anchor_y = kernel_height / 2;
+    const size_t length = static_cast<size_t>(width) * channels;
+    const size_t padded_length = static_cast<size_t>(width + kernel_width - 1) * channels;
+    const std::vector<float> weights(kernel.begin(), kernel.end());
+    parallel_bands(height, [&](const int32_t begin, const int32_t end) {
+        std::vector<float> ring(kernel_height * padded_length);
+        std::vector<float> sum(length);
+        auto load = [&](const int32_t row, float* slot) {
+            load_padded_row(src + row * length, slot, width, channels, anchor_x, kernel_width - 1 - anchor_x);
+        };
+        auto produce = [&](const int32_t row, const std::vector<const float*>& rows) {
+            std::fill(sum.begin(), sum.end(), 0.0f);
+            for (int32_t tap_y = 0; tap_y < kernel_height; ++tap_y)
+                for (int32_t tap_x = 0; tap_x < kernel_width; ++tap_x) {
+                    const float weight = weights[tap_y * kernel_width + tap_x];
+                    if (weight == 0.0f)
+                        continue;
+                    add_scaled_row(sum.data(), rows[tap_y] + tap_x * channels, weight, length);
+                }
+            store_row(sum.data(), dst + row * length, length);
+        };
+        ring_rows(begin, end, height, kernel_height, anchor_y, ring, padded_length, load, produce);
+    });
+}
+
+// Overlap-save: every size x size tile of clamped source pixels yields a (size - kernel + 1)^2 block of output
+// that no circular wrap reaches. Two channels share one complex transform as its real and imaginary parts,
+// which is exact because the kernel is real.
+static void convolve_fourier(const uint8_t* src, uint8_t* dst, const int32_t height, const int32_t width,
+    const int32_t channels, const std::vector<double>& kernel, const int32_t kernel_width,
+    const int32_t kernel_height, const int32_t size)
+{
+    const Fft fft(size);
+    const int32_t anchor_x = kernel_width / 2;
+    const int32_t anchor_y = kernel_height / 2;
+    const int32_t valid_x = size - kernel_width + 1;
+    const int32_t valid_y = size - kernel_height + 1;
+    const size_t points = static_cast<size_t>(size) * size;
+    std::vector<std::complex<float> > spectrum(points);
+    std::vector<std::complex<float> > column(size);
+    for (int32_t row = 0; row < kernel_height; ++row)
+        for (int32_t col = 0; col < kernel_width; ++col)
+            spectrum[row * size + col] = static_cast<float>(kernel[row * kernel_width + col]);
+    fft.transform_2d(spectrum.data(), false, column.data());
+    const float scale = 1.0f / static_cast<float>(points);
+    for (std::complex<float>& value : spectrum)
+        value = std::conj(value) * scale;
+    const int32_t tiles_y = (height + valid_y - 1) / valid_y;
+    const int32_t tiles_x = (width + valid_x - 1) / valid_x;
+    parallel_bands(tiles_y, [&](const int32_t begin, const int32_t end) {
+        std::vector<std::complex<float> > tile(points);
+        std::vector<std::complex<float> > scratch(size);
+        for (int32_t tile_y = begin; tile_y < end; ++tile_y)
+            for (int32_t tile_x = 0; tile_x < tiles_x; ++tile_x) {
+                const int32_t origin_y = tile_y * valid_y;
+                const int32_t origin_x = tile_x * valid_x;
+                const int32_t rows = std::min(valid_y, height - origin_y);
+                const int32_t cols = std::min(valid_x, width - origin_x);
+                for (int32_t first = 0; first < channels; first += 2) {
+                    const int32_t second = first + 1 < channels ? first + 1 : -1;
+                    for (int32_t y = 0; y < size; ++y) {
+                        const uint8_t* src_row = src
+                            + static_cast<size_t>(std::clamp(origin_y - anchor_y + y, 0, height - 1)) * width
+                            * channels;
+                        for (int32_t x = 0; x < size; ++x) {
+                            const uint8_t* pixel = src_row
+                                + std::clamp(origin_x - anchor_x + x, 0, width - 1) * channels;
+                            tile[y * size + x] = { static_cast<float>(pixel[first]),
+                                second < 0 ? 0.0f : static_cast<float>(pixel[second]) };
+                        }
+                    }
+                    fft.transform_2d(tile.data(), false, scratch.data());
+                    for (size_t i = 0; i < points; ++i) {
+                        const float re = tile[i].real() * spectrum[i].real() - tile[i].imag() * spectrum[i].imag();
+                        const float im = tile[i].real() * spectrum[i].imag() + tile[i].imag() * spectrum[i].real();
+                        tile[i] = { re, im };
+                    }
+                    fft.transform_2d(tile.data(), true, scratch.data());
+                    for (int32_t y = 0; y < rows; ++y) {
+                        uint8_t* dst_row = dst + (static_cast<size_t>(origin_y + y) * width + origin_x) * channels;
+                        for (int32_t x = 0; x < cols; ++x) {
+                            dst_row[x * channels + first] = to_byte(tile[y * size + x].real());
+                            if (0 <= second)
+                                dst_row[x * channels + second] = to_byte(tile[y * size + x].imag());
+                        }
+                    }
+                }
+            }
+    }, 1);
+}
+
+void convolve_filter(const uint8_t* src, uint8_t* dst, const int32_t height, const int32_t width,
+    const int32_t channels, const std::vector<double>& kernel, const int32_t kernel_width,
+    const int32_t kernel_height)
+{
+    if (kernel_width <= 0 || kernel_height <= 0 || kernel.size() != static_cast<size_t>(kernel_width) * kernel_height)
+        throw std::exception();
+    switch (choose_convolve_path(kernel, kernel_width, kernel_height)) {
+    case ConvolvePath::Separable:
+        convolve_separable(src, dst, height, width, channels, split_kernel(kernel, kernel_width, kernel_height));
+        break;
+    case ConvolvePath::Direct:
+        convolve_direct(src, dst, height, width, channels, kernel, kernel_width, kernel_height);
+        break;
+    case ConvolvePath::Fourier: {
+        double cost = 0;
+        convolve_fourier(src, dst, height, width, channels, kernel, kernel_width, kernel_height,
+            fourier_size(kernel_width, kernel_height, cost));
+        break;
+    }
+    }
+}
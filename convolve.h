@@ -0,0 +1,21 @@
+#pragma once
+
+#ifndef CONVOLVE_H
+#define CONVOLVE_H
+
+#include <cstdint>
+#include <vector>
+
+enum class ConvolvePath : uint8_t {
+    Separable,
+    Direct,
+    Fourier
+};
+
+// Row major kernel, applied the way the built in 3x3 kernels are: kernel[0] weighs the top left neighbour and
+// the anchor is (kernel_height / 2, kernel_width / 2). Edge pixels are replicated.
+ConvolvePath choose_convolve_path(const std::vector<double>& kernel, int32_t kernel_width, int32_t kernel_height);
+void convolve_filter(const uint8_t* src, uint8_t* dst, int32_t height, int32_t width, int32_t channels,
+    const std::vector<double>& kernel, int32_t kernel_width, int32_t kernel_height);
+
+#endif //CONVOLVE_H
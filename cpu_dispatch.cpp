@@ -0,0 +1,61 @@
+#include "cpu_dispatch.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+
+SimdLevel detected_simd_level()
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")
+        && __builtin_cpu_supports("avx512vl"))
+        return SimdLevel::Avx512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return SimdLevel::Avx2;
+    if (__builtin_cpu_supports("sse4.1"))
+        return SimdLevel::Sse41;
+#endif
+    return SimdLevel::Scalar;
+}
+
+static SimdLevel requested_simd_level(const SimdLevel detected)
+{
+    const char* value = std::getenv("IMAGES_SIMD");
+    if (value == nullptr)
+        return detected;
+    for (const SimdLevel level : { SimdLevel::Scalar, SimdLevel::Sse41, SimdLevel::Avx2, SimdLevel::Avx512 })
+        if (std::strcmp(value, simd_level_name(level)) == 0)
+            return level < detected ? level : detected;
+    return detected;
+}
+
+SimdLevel simd_level()
+{
+    static const SimdLevel level = requested_simd_level(detected_simd_level());
+    return level;
+}
+
+bool carryless_multiply_supported()
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    static const bool supported = simd_level() != SimdLevel::Scalar && __builtin_cpu_supports("pclmul");
+    return supported;
+#else
+    return false;
+#endif
+}
+
+const char* simd_level_name(const SimdLevel level)
+{
+    switch (level) {
+    case SimdLevel::Sse41:
+        return "sse4.1";
+    case SimdLevel::Avx2:
+        return "avx2";
+    case SimdLevel::Avx512:
+        return "avx512";
+    default:
+        return "scalar";
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#ifndef CPU_DISPATCH_H
+#define CPU_DISPATCH_H
+
+#include <cstdint>
+
+enum class SimdLevel : uint8_t {
+    Scalar,
+    Sse41,
+    Avx2,
+    Avx512
+};
+
+// Best level the processor and operating system support.
+SimdLevel detected_simd_level();
+// Level the kernels run at: the detected one, lowered by IMAGES_SIMD=scalar|sse4.1|avx2|avx512 if set.
+SimdLevel simd_level();
+const char* simd_level_name(SimdLevel level);
+// Whether carry-less multiplication (PCLMULQDQ) may be used: the processor has it and simd_level() is not scalar.
+bool carryless_multiply_supported();
+
+template <typename Function>
+Function* select_simd(Function* scalar, Function* sse41, Function* avx2, Function* avx512)
+{
+    switch (simd_level()) {
+    case SimdLevel::Avx512:
+        return avx512;
+    case SimdLevel::Avx2:
+        return avx2;
+    case SimdLevel::Sse41:
+        return sse41;
+    default:
+        return scalar;
+    }
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define SIMD_TARGET_AVX512 __attribute__((target("avx512f,avx512bw,avx512vl,avx2,fma")))
+#define SIMD_TARGET_PCLMUL __attribute__((target("pclmul,sse4.1")))
+#define SIMD_INLINE [[gnu::always_inline]] static inline
+#else
+#define SIMD_TARGET_SSE41
+#define SIMD_TARGET_AVX2
+#define SIMD_TARGET_AVX512
+#define SIMD_TARGET_PCLMUL
+#define SIMD_INLINE static inline
+#endif
+
+// Defines the static function `name` as a call through a pointer chosen once by simd_level(). Each variant
+// inlines the SIMD_INLINE function `body`, so the compiler vectorizes it again for that instruction set.
+#define SIMD_DISPATCH(result, name, body, parameters, arguments) \
+    static result name##_scalar parameters { return body arguments; } \
+    SIMD_TARGET_SSE41 static result name##_sse41 parameters { return body arguments; } \
+    SIMD_TARGET_AVX2 static result name##_avx2 parameters { return body arguments; } \
+    SIMD_TARGET_AVX512 static result name##_avx512 parameters { return body arguments; } \
+    static result name parameters \
+    { \
+        static const auto function = select_simd(name##_scalar, name##_sse41, name##_avx2, name##_avx512); \
+        return function arguments; \
+    }
+
+#endif //CPU_DISPATCH_H
@@ -0,0 +1,656 @@
+#include "deflate.h"
+
+#include "checksum.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <cstring>
+
+static constexpr size_t s_window = size_t(1) << 15;
+static constexpr uint32_t s_min_match = 3;
+static constexpr uint32_t s_max_match = 258;
+static constexpr uint32_t s_too_far = 4096;
+static constexpr int32_t s_hash_bits = 15;
+static constexpr size_t s_block_symbols = size_t(1) << 15;
+// Positions inside a Compressor are 32 bits, so longer input is compressed in segments primed with the window.
+static constexpr size_t s_segment = size_t(1) << 30;
+// zlib_compress splits its input into bands of whole units, at least 16 of them (1 MiB) per band.
+static constexpr size_t s_band_unit = size_t(1) << 16;
+static constexpr int32_t s_max_code_length = 15;
+static constexpr int32_t s_max_code_length_code = 7;
+static constexpr int32_t s_litlen_count = 286;
+static constexpr int32_t s_distance_count = 30;
+static constexpr uint32_t s_end_of_block = 256;
+
+static constexpr uint16_t s_length_base[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51,
+    59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static constexpr uint8_t s_length_extra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4,
+    5, 5, 5, 5, 0 };
+static constexpr uint16_t s_distance_base[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385,
+    513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static constexpr uint8_t s_distance_extra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10,
+    10, 11, 11, 12, 12, 13, 13 };
+static constexpr uint8_t s_code_length_order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1,
+    15 };
+static constexpr uint8_t s_code_length_extra[19] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 3, 7 };
+
+// zlib's tuning per level: chains are cut to a quarter once a match of `good` is in hand, matches of `lazy` or more
+// aren't looked past (levels 1 to 3 are greedy and only index the positions inside matches up to `lazy`), a match
+// of `nice` ends the search and at most `chain` positions are tried.
+struct CompressionLevel {
+    uint16_t good;
+    uint16_t lazy;
+    uint16_t nice;
+    uint16_t chain;
+};
+
+static constexpr CompressionLevel s_levels[10] = { { 0, 0, 0, 0 }, { 4, 4, 8, 4 }, { 4, 5, 16, 8 }, { 4, 6, 32, 32 },
+    { 4, 4, 16, 16 }, { 8, 16, 32, 32 }, { 8, 16, 128, 128 }, { 8, 32, 128, 256 }, { 32, 128, 258, 1024 },
+    { 32, 258, 258, 4096 } };
+
+static constexpr std::array<uint8_t, s_max_match + 1> make_length_codes()
+{
+    std::array<uint8_t, s_max_match + 1> codes{};
+    for (uint8_t code = 0; code < 29; ++code) {
+        const uint32_t end = code == 28 ? s_max_match + 1 : s_length_base[code + 1];
+        for (uint32_t length = s_length_base[code]; length < end; ++length)
+            codes[length] = code;
+    }
+    return codes;
+}
+
+static constexpr std::array<uint8_t, s_max_match + 1> s_length_codes = make_length_codes();
+
+static uint32_t distance_code(const uint32_t distance)
+{
+    const uint32_t offset = distance - 1;
+    if (offset < 4)
+        return offset;
+    const auto bits = static_cast<uint32_t>(std::bit_width(offset) - 1);
+    return 2 * bits + (offset >> (bits - 1) & 1);
+}
+
+static uint32_t reverse_bits(uint32_t code, const int32_t length)
+{
+    uint32_t result = 0;
+    for (int32_t i = 0; i < length; ++i) {
+        result = result << 1 | (code & 1);
+        code >>= 1;
+    }
+    return result;
+}
+
+// Lengths of a Huffman code for `frequencies`, none longer than `limit`; unused symbols get 0. The tree is built
+// with the two-queue method over the sorted symbols; lengths past the limit are folded back and the Kraft sum is
+// repaired by lengthening the deepest shorter codes, as miniz does.
+static void build_lengths(const uint32_t* frequencies, const int32_t count, const int32_t limit, uint8_t* lengths)
+{
+    std::fill_n(lengths, count, 0);
+    std::vector<std::pair<uint32_t, int32_t> > symbols;
+    for (int32_t symbol = 0; symbol < count; ++symbol)
+        if (frequencies[symbol] != 0)
+            symbols.emplace_back(frequencies[symbol], symbol);
+    if (symbols.size() < 2) {
+        if (!symbols.empty())
+            lengths[symbols[0].second] = 1;
+        return;
+    }
+    std::sort(symbols.begin(), symbols.end());
+    const size_t leaves = symbols.size();
+    std::vector<uint64_t> weight(2 * leaves - 1);
+    std::vector<size_t> parent(2 * leaves - 1);
+    for (size_t i = 0; i < leaves; ++i)
+        weight[i] = symbols[i].first;
+    size_t leaf = 0;
+    size_t node = leaves;
+    for (size_t next = leaves; next < 2 * leaves - 1; ++next) {
+        size_t picked[2];
+        for (size_t& pick : picked)
+            pick = leaf < leaves && (node == next || weight[leaf] <= weight[node]) ? leaf++ : node++;
+        weight[next] = weight[picked[0]] + weight[picked[1]];
+        parent[picked[0]] = next;
+        parent[picked[1]] = next;
+    }
+    std::vector<int32_t> depth(2 * leaves - 1);
+    int32_t counts[s_max_code_length + 1] = {};
+    for (size_t i = 2 * leaves - 2; i-- != 0;) {
+        depth[i] = depth[parent[i]] + 1;
+        if (i < leaves)
+            ++counts[std::min(depth[i], limit)];
+    }
+    uint32_t total = 0;
+    for (int32_t length = 1; length <= limit; ++length)
+        total += static_cast<uint32_t>(counts[length]) << (limit - length);
+    while (uint32_t(1) << limit < total) {
+        --counts[limit];
+        for (int32_t length = limit - 1; 0 < length; --length)
+            if (counts[length] != 0) {
+                --counts[length];
+                counts[length + 1] += 2;
+                break;
+            }
+        --total;
+    }
+    size_t next = 0;
+    for (int32_t length = limit; 0 < length; --length)
+        for (int32_t i = 0; i < counts[length]; ++i)
+            lengths[symbols[next++].second] = static_cast<uint8_t>(length);
+}
+
+// Canonical codes for `lengths`, bit reversed since deflate sends them first bit first.
+static void make_codes(const uint8_t* lengths, const int32_t count, uint16_t* codes)
+{
+    uint32_t counts[s_max_code_length + 1] = {};
+    for (int32_t symbol = 0; symbol < count; ++symbol)
+        ++counts[lengths[symbol]];
+    counts[0] = 0;
+    uint32_t next[s_max_code_length + 1] = {};
+    uint32_t code = 0;
+    for (int32_t length = 1; length <= s_max_code_length; ++length) {
+        code = (code + counts[length - 1]) << 1;
+        next[length] = code;
+    }
+    for (int32_t symbol = 0; symbol < count; ++symbol)
+        if (lengths[symbol] != 0)
+            codes[symbol] = static_cast<uint16_t>(reverse_bits(next[lengths[symbol]]++, lengths[symbol]));
+}
+
+struct FixedCodes {
+    uint8_t litlen_lengths[288];
+    uint8_t distance_lengths[s_distance_count];
+    uint16_t litlen_codes[288];
+    uint16_t distance_codes[s_distance_count];
+
+    FixedCodes()
+    {
+        std::fill_n(litlen_lengths, 144, 8);
+        std::fill_n(litlen_lengths + 144, 112, 9);
+        std::fill_n(litlen_lengths + 256, 24, 7);
+        std::fill_n(litlen_lengths + 280, 8, 8);
+        std::fill_n(distance_lengths, s_distance_count, 5);
+        make_codes(litlen_lengths, 288, litlen_codes);
+        make_codes(distance_lengths, s_distance_count, distance_codes);
+    }
+};
+
+static const FixedCodes& fixed_codes()
+{
+    static const FixedCodes codes;
+    return codes;
+}
+
+class BitWriter {
+    std::vector<uint8_t>& m_out;
+    uint64_t m_bits;
+    int32_t m_count;
+
+public:
+    // CREATORS
+    explicit BitWriter(std::vector<uint8_t>& out)
+        : m_out(out), m_bits(0), m_count(0)
+    {
+    }
+
+    // MANIPULATORS
+    // Appends the low `count` bits of `value`, at most 32, lowest first.
+    void put(const uint32_t value, const int32_t count)
+    {
+        m_bits |= static_cast<uint64_t>(value) << m_count;
+        m_count += count;
+        if (m_count < 32)
+            return;
+        const size_t size = m_out.size();
+        m_out.resize(size + 4);
+        for (int32_t i = 0; i < 4; ++i)
+            m_out[size + i] = static_cast<uint8_t>(m_bits >> 8 * i);
+        m_bits >>= 32;
+        m_count -= 32;
+    }
+
+    // Pads with zero bits to a byte boundary and writes out everything buffered.
+    void align()
+    {
+        for (; 0 < m_count; m_count -= 8) {
+            m_out.push_back(static_cast<uint8_t>(m_bits));
+            m_bits >>= 8;
+        }
+        m_bits = 0;
+        m_count = 0;
+    }
+
+    // Appends bytes as they are; only on a byte boundary.
+    void bytes(const uint8_t* data, const size_t size)
+    {
+        align();
+        m_out.insert(m_out.end(), data, data + size);
+    }
+};
+
+// A literal when `distance` is 0, otherwise a match of `value` bytes.
+struct Symbol {
+    uint16_t value;
+    uint16_t distance;
+};
+
+class Compressor {
+    const uint8_t* m_data;
+    size_t m_size;
+    int32_t m_level;
+    CompressionLevel m_parameters;
+    BitWriter m_writer;
+    // Position + 1 of the latest occurrence of each hash and, per window slot, of the one before it; 0 for none.
+    std::vector<uint32_t> m_head;
+    std::vector<uint32_t> m_previous;
+    std::vector<Symbol> m_symbols;
+    // The input the buffered symbols stand for.
+    size_t m_block_start;
+    size_t m_covered;
+
+public:
+    // CREATORS
+    Compressor(const uint8_t* data, const size_t size, const int32_t level, std::vector<uint8_t>& out)
+        : m_data(data), m_size(size), m_level(level), m_parameters(s_levels[level]), m_writer(out)
+        , m_block_start(0), m_covered(0)
+    {
+    }
+
+    // MANIPULATORS
+    void run(size_t history, bool last);
+private:
+    [[nodiscard]] uint32_t hash(const size_t position) const
+    {
+        uint32_t word;
+        std::memcpy(&word, m_data + position, 4);
+        return word * 0x9E3779B1u >> (32 - s_hash_bits);
+    }
+
+    void insert(const size_t position)
+    {
+        uint32_t& head = m_head[hash(position)];
+        m_previous[position & (s_window - 1)] = head;
+        head = static_cast<uint32_t>(position + 1);
+    }
+
+    [[nodiscard]] uint32_t find_match(size_t position, uint32_t longer_than, uint32_t chain,
+        uint32_t& distance) const;
+    void literal(size_t position);
+    void match(size_t position, uint32_t length, uint32_t distance);
+    void compress_greedy(size_t position);
+    void compress_lazy(size_t position);
+    void flush_block(bool last);
+    void write_stored(const uint8_t* data, size_t size, bool last);
+    void write_symbols(const uint8_t* litlen_lengths, const uint16_t* litlen_codes, const uint8_t* distance_lengths,
+        const uint16_t* distance_codes);
+};
+
+static uint32_t match_length(const uint8_t* a, const uint8_t* b, const uint32_t limit)
+{
+    uint32_t length = 0;
+    while (length + 8 <= limit) {
+        uint64_t x;
+        uint64_t y;
+        std::memcpy(&x, a + length, 8);
+        std::memcpy(&y, b + length, 8);
+        if (x != y)
+            return length + static_cast<uint32_t>(std::countr_zero(x ^ y)) / 8;
+        length += 8;
+    }
+    while (length < limit && a[length] == b[length])
+        ++length;
+    return length;
+}
+
+// The longest earlier occurrence of the bytes at `position` that is longer than `longer_than`, or 0.
+uint32_t Compressor::find_match(const size_t position, const uint32_t longer_than, uint32_t chain,
+    uint32_t& distance) const
+{
+    const auto limit = static_cast<uint32_t>(std::min<size_t>(s_max_match, m_size - position));
+    if (limit <= longer_than)
+        return 0;
+    const uint32_t nice = std::min<uint32_t>(m_parameters.nice, limit);
+    const size_t oldest = position < s_window ? 0 : position - s_window;
+    const uint8_t* current = m_data + position;
+    uint32_t best = longer_than;
+    for (uint32_t link = m_head[hash(position)]; link != 0 && chain-- != 0;) {
+        const size_t candidate = link - 1;
+        if (candidate < oldest || position <= candidate)
+            break;
+        const uint8_t* earlier = m_data + candidate;
+        if (earlier[best] == current[best]) {
+            const uint32_t length = match_length(earlier, current, limit);
+            if (best < length) {
+                best = length;
+                distance = static_cast<uint32_t>(position - candidate);
+                if (nice <= length)
+                    break;
+            }
+        }
+        link = m_previous[candidate & (s_window - 1)];
+    }
+    if (best == longer_than || (best == s_min_match && s_too_far < distance))
+        return 0;
+    return best;
+}
+
+void Compressor::literal(const size_t position)
+{
+    m_symbols.push_back({ m_data[position], 0 });
+    m_covered = position + 1;
+    if (m_symbols.size() == s_block_symbols)
+        flush_block(false);
+}
+
+void Compressor::match(const size_t position, const uint32_t length, const uint32_t distance)
+{
+    m_symbols.push_back({ static_cast<uint16_t>(length), static_cast<uint16_t>(distance) });
+    m_covered = position + length;
+    if (m_symbols.size() == s_block_symbols)
+        flush_block(false);
+}
+
+void Compressor::run(const size_t history, const bool last)
+{
+    m_block_start = history;
+    m_covered = history;
+    if (m_level == 0) {
+        write_stored(m_data + history, m_size - history, last);
+    } else {
+        m_head.assign(size_t(1) << s_hash_bits, 0);
+        m_previous.assign(s_window, 0);
+        m_symbols.reserve(s_block_symbols);
+        for (size_t position = history < s_window ? 0 : history - s_window; position < history; ++position)
+            if (position + 4 <= m_size)
+                insert(position);
+        if (m_level <= 3)
+            compress_greedy(history);
+        else
+            compress_lazy(history);
+        if (last || !m_symbols.empty())
+            flush_block(last);
+    }
+    if (!last)
+        write_stored(nullptr, 0, false);
+    m_writer.align();
+}
+
+void Compressor::compress_greedy(size_t position)
+{
+    while (position < m_size) {
+        uint32_t distance = 0;
+        uint32_t length = 0;
+        if (position + 4 <= m_size) {
+            length = find_match(position, s_min_match - 1, m_parameters.chain, distance);
+            insert(position);
+        }
+        if (length == 0) {
+            literal(position++);
+            continue;
+        }
+        match(position, length, distance);
+        const size_t end = position + length;
+        if (length <= m_parameters.lazy)
+            for (++position; position < end && position + 4 <= m_size; ++position)
+                insert(position);
+        position = end;
+    }
+}
+
+// zlib's lazy evaluation: a match is only taken when the next position doesn't start a longer one.
+void Compressor::compress_lazy(size_t position)
+{
+    uint32_t previous_length = 0;
+    uint32_t previous_distance = 0;
+    bool pending = false;
+    while (position < m_size) {
+        uint32_t distance = 0;
+        uint32_t length = 0;
+        if (position + 4 <= m_size) {
+            if (previous_length < m_parameters.lazy) {
+                const uint32_t chain = previous_length < m_parameters.good
+                    ? m_parameters.chain : m_parameters.chain >> 2;
+                length = find_match(position, std::max(previous_length, s_min_match - 1), chain, distance);
+            }
+            insert(position);
+        }
+        if (s_min_match <= previous_length && length == 0) {
+            match(position - 1, previous_length, previous_distance);
+            const size_t end = position - 1 + previous_length;
+            for (++position; position < end && position + 4 <= m_size; ++position)
+                insert(position);
+            position = end;
+            pending = false;
+            previous_length = 0;
+            continue;
+        }
+        if (pending)
+            literal(position - 1);
+        pending = true;
+        previous_length = length;
+        previous_distance = distance;
+        ++position;
+    }
+    if (pending)
+        literal(position - 1);
+}
+
+// Writes the buffered symbols as a dynamic, fixed or stored block, whichever is smallest.
+void Compressor::flush_block(const bool last)
+{
+    uint32_t litlen_frequencies[s_litlen_count] = {};
+    uint32_t distance_frequencies[s_distance_count] = {};
+    uint64_t extra_bits = 0;
+    for (const Symbol& symbol : m_symbols) {
+        if (symbol.distance == 0) {
+            ++litlen_frequencies[symbol.value];
+            continue;
+        }
+        const uint32_t length_code = s_length_codes[symbol.value];
+        const uint32_t distance = distance_code(symbol.distance);
+        ++litlen_frequencies[257 + length_code];
+        ++distance_frequencies[distance];
+        extra_bits += s_length_extra[length_code] + s_distance_extra[distance];
+    }
+    litlen_frequencies[s_end_of_block] = 1;
+    // A lone code would be incomplete, so both get at least two used symbols.
+    for (auto [frequencies, count] : { std::pair(litlen_frequencies, s_litlen_count),
+             std::pair(distance_frequencies, s_distance_count) }) {
+        auto used = std::count_if(frequencies, frequencies + count, [](const uint32_t value) { return value != 0; });
+        for (int32_t symbol = 0; used < 2; ++symbol)
+            if (frequencies[symbol] == 0) {
+                frequencies[symbol] = 1;
+                ++used;
+            }
+    }
+
+    uint8_t lengths[s_litlen_count + s_distance_count];
+    uint8_t* litlen_lengths = lengths;
+    uint8_t* distance_lengths = lengths + s_litlen_count;
+    build_lengths(litlen_frequencies, s_litlen_count, s_max_code_length, litlen_lengths);
+    build_lengths(distance_frequencies, s_distance_count, s_max_code_length, distance_lengths);
+    int32_t litlen_count = s_litlen_count;
+    while (257 < litlen_count && litlen_lengths[litlen_count - 1] == 0)
+        --litlen_count;
+    int32_t distance_count = s_distance_count;
+    while (1 < distance_count && distance_lengths[distance_count - 1] == 0)
+        --distance_count;
+
+    // The code lengths, run length coded: 16 repeats the previous length 3 to 6 times, 17 and 18 give 3 to 10 and
+    // 11 to 138 zeros.
+    uint8_t sequence[s_litlen_count + s_distance_count];
+    std::copy_n(litlen_lengths, litlen_count, sequence);
+    std::copy_n(distance_lengths, distance_count, sequence + litlen_count);
+    const int32_t sequence_length = litlen_count + distance_count;
+    std::vector<std::pair<uint8_t, uint8_t> > runs;
+    for (int32_t i = 0; i < sequence_length;) {
+        const uint8_t length = sequence[i];
+        int32_t run = 1;
+        while (i + run < sequence_length && sequence[i + run] == length)
+            ++run;
+        i += run;
+        if (length == 0) {
+            for (; 11 <= run; run -= std::min(run, 138))
+                runs.emplace_back(18, std::min(run, 138) - 11);
+            if (3 <= run) {
+                runs.emplace_back(17, run - 3);
+                run = 0;
+            }
+        } else {
+            runs.emplace_back(length, 0);
+            for (--run; 3 <= run; run -= std::min(run, 6))
+                runs.emplace_back(16, std::min(run, 6) - 3);
+        }
+        for (; 0 < run; --run)
+            runs.emplace_back(length, 0);
+    }
+    uint32_t code_length_frequencies[19] = {};
+    for (const auto& [symbol, extra] : runs)
+        ++code_length_frequencies[symbol];
+    uint8_t code_length_lengths[19];
+    build_lengths(code_length_frequencies, 19, s_max_code_length_code, code_length_lengths);
+    int32_t code_length_count = 19;
+    while (4 < code_length_count && code_length_lengths[s_code_length_order[code_length_count - 1]] == 0)
+        --code_length_count;
+
+    uint64_t dynamic_bits = 3 + 14 + 3 * code_length_count + extra_bits;
+    uint64_t fixed_bits = 3 + extra_bits;
+    const FixedCodes& fixed = fixed_codes();
+    for (int32_t symbol = 0; symbol < 19; ++symbol)
+        dynamic_bits += code_length_frequencies[symbol]
+            * static_cast<uint64_t>(code_length_lengths[symbol] + s_code_length_extra[symbol]);
+    for (int32_t symbol = 0; symbol < s_litlen_count; ++symbol) {
+        dynamic_bits += static_cast<uint64_t>(litlen_frequencies[symbol]) * litlen_lengths[symbol];
+        fixed_bits += static_cast<uint64_t>(litlen_frequencies[symbol]) * fixed.litlen_lengths[symbol];
+    }
+    for (int32_t symbol = 0; symbol < s_distance_count; ++symbol) {
+        dynamic_bits += static_cast<uint64_t>(distance_frequencies[symbol]) * distance_lengths[symbol];
+        fixed_bits += static_cast<uint64_t>(distance_frequencies[symbol]) * fixed.distance_lengths[symbol];
+    }
+    const size_t raw = m_covered - m_block_start;
+    const uint64_t stored_bits = (raw / 65535 + 1) * 42 + raw * 8;
+
+    if (stored_bits <= std::min(dynamic_bits, fixed_bits)) {
+        write_stored(m_data + m_block_start, raw, last);
+    } else if (fixed_bits <= dynamic_bits) {
+        m_writer.put(last, 1);
+        m_writer.put(1, 2);
+        write_symbols(fixed.litlen_lengths, fixed.litlen_codes, fixed.distance_lengths, fixed.distance_codes);
+    } else {
+        uint16_t litlen_codes[s_litlen_count];
+        uint16_t distance_codes[s_distance_count];
+        uint16_t code_length_codes[19];
+        make_codes(litlen_lengths, s_litlen_count, litlen_codes);
+        make_codes(distance_lengths, s_distance_count, distance_codes);
+        make_codes(code_length_lengths, 19, code_length_codes);
+        m_writer.put(last, 1);
+        m_writer.put(2, 2);
+        m_writer.put(litlen_count - 257, 5);
+        m_writer.put(distance_count - 1, 5);
+        m_writer.put(code_length_count - 4, 4);
+        for (int32_t i = 0; i < code_length_count; ++i)
+            m_writer.put(code_length_lengths[s_code_length_order[i]], 3);
+        for (const auto& [symbol, extra] : runs) {
+            m_writer.put(code_length_codes[symbol], code_length_lengths[symbol]);
+            m_writer.put(extra, s_code_length_extra[symbol]);
+        }
+        write_symbols(litlen_lengths, litlen_codes, distance_lengths, distance_codes);
+    }
+    m_symbols.clear();
+    m_block_start = m_covered;
+}
+
+void Compressor::write_symbols(const uint8_t* litlen_lengths, const uint16_t* litlen_codes,
+    const uint8_t* distance_lengths, const uint16_t* distance_codes)
+{
+    for (const Symbol& symbol : m_symbols) {
+        if (symbol.distance == 0) {
+            m_writer.put(litlen_codes[symbol.value], litlen_lengths[symbol.value]);
+            continue;
+        }
+        const uint32_t length_code = s_length_codes[symbol.value];
+        m_writer.put(litlen_codes[257 + length_code], litlen_lengths[257 + length_code]);
+        m_writer.put(symbol.value - s_length_base[length_code], s_length_extra[length_code]);
+        const uint32_t distance = distance_code(symbol.distance);
+        m_writer.put(distance_codes[distance], distance_lengths[distance]);
+        m_writer.put(symbol.distance - s_distance_base[distance], s_distance_extra[distance]);
+    }
+    m_writer.put(litlen_codes[s_end_of_block], litlen_lengths[s_end_of_block]);
+}
+
+// Stored blocks of at most 65535 bytes; one empty block when there is no data.
+void Compressor::write_stored(const uint8_t* data, size_t size, const bool last)
+{
+    do {
+        const size_t count = std::min<size_t>(size, 65535);
+        m_writer.put(last && count == size, 1);
+        m_writer.put(0, 2);
+        m_writer.align();
+        m_writer.put(static_cast<uint32_t>(count), 16);
+        m_writer.put(static_cast<uint32_t>(~count & 0xFFFF), 16);
+        m_writer.bytes(data, count);
+        data += count;
+        size -= count;
+    } while (size != 0);
+}
+
+void deflate_raw(const uint8_t* data, const size_t size, const size_t history, const int32_t level, const bool last,
+    std::vector<uint8_t>& out)
+{
+    assert(0 <= level && level <= 9 && "compression level out of range");
+    assert(history <= size && "history past the end of the data");
+    size_t begin = history;
+    do {
+        const size_t end = std::min(size, begin + s_segment);
+        const size_t keep = std::min(begin, s_window);
+        Compressor(data + begin - keep, end - begin + keep, level, out).run(keep, last && end == size);
+        begin = end;
+    } while (begin < size);
+}
+
+void zlib_header(const int32_t level, std::vector<uint8_t>& out)
+{
+    // CMF: deflate with a 32K window. FLG: zlib's level class in the top two bits and the check bits below.
+    const uint32_t cmf = 0x78;
+    uint32_t flg = (level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3) << 6;
+    flg += (31 - (cmf << 8 | flg) % 31) % 31;
+    out.push_back(static_cast<uint8_t>(cmf));
+    out.push_back(static_cast<uint8_t>(flg));
+}
+
+std::vector<uint8_t> zlib_compress(const uint8_t* data, const size_t size, const int32_t level)
+{
+    // As pigz does, bands are deflated on their own threads, each primed with the 32K in front of it and ending on
+    // a sync flush, so that they join into one stream; their Adler-32s are combined.
+    const auto units = static_cast<int32_t>(std::max<size_t>(1, (size + s_band_unit - 1) / s_band_unit));
+    std::vector<std::vector<uint8_t> > bands(units);
+    std::vector<uint32_t> checksums(units);
+    std::vector<size_t> sizes(units);
+    parallel_bands(units, [&](const int32_t begin, const int32_t end) {
+        const size_t first = begin * s_band_unit;
+        const size_t last = std::min(size, end * s_band_unit);
+        const size_t history = std::min(first, s_window);
+        bands[begin].reserve((last - first) / 4 + 64);
+        deflate_raw(data + first - history, last - first + history, history, level, last == size, bands[begin]);
+        checksums[begin] = adler32(1, data + first, last - first);
+        sizes[begin] = last - first;
+    });
+
+    std::vector<uint8_t> out;
+    size_t total = 6;
+    for (const std::vector<uint8_t>& band : bands)
+        total += band.size();
+    out.reserve(total);
+    zlib_header(level, out);
+    uint32_t adler = 1;
+    for (int32_t band = 0; band < units; ++band) {
+        if (bands[band].empty())
+            continue;
+        out.insert(out.end(), bands[band].begin(), bands[band].end());
+        adler = adler32_combine(adler, checksums[band], sizes[band]);
+    }
+    for (int32_t shift = 24; 0 <= shift; shift -= 8)
+        out.push_back(static_cast<uint8_t>(adler >> shift));
+    return out;
+}
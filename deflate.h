@@ -0,0 +1,22 @@
+#pragma once
+
+#ifndef DEFLATE_H
+#define DEFLATE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Compresses into a zlib stream (RFC 1950) at `level` 0 (stored) to 9 (smallest and slowest); 6 is zlib's default.
+// Input of 2 MiB or more is compressed in bands on several threads.
+std::vector<uint8_t> zlib_compress(const uint8_t* data, size_t size, int32_t level = 6);
+
+// Appends raw deflate data (RFC 1951) for data[history, size) to `out`. The `history` bytes in front, of which the
+// last 32K are used, can be matched as if they had been compressed earlier in the same stream. Unless `last`, the
+// output ends with an empty stored block, so it stops on a byte boundary and more deflate data can follow it.
+void deflate_raw(const uint8_t* data, size_t size, size_t history, int32_t level, bool last,
+    std::vector<uint8_t>& out);
+// Appends the two header bytes of a zlib stream for deflate data compressed at `level`.
+void zlib_header(int32_t level, std::vector<uint8_t>& out);
+
+#endif //DEFLATE_H
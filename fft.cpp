@@ -0,0 +1,62 @@
+#include "fft.h"
+
+#include <cassert>
+#include <cmath>
+#include <numbers>
+#include <utility>
+
+Fft::Fft(const int32_t size)
+    : m_size(size), m_reversed(size), m_twiddles(size / 2)
+{
+    assert(0 < size && (size & (size - 1)) == 0 && "fft size must be a power of two");
+    int32_t bits = 0;
+    while ((1 << bits) < size)
+        ++bits;
+    for (int32_t i = 0; i < size; ++i) {
+        int32_t reversed = 0;
+        for (int32_t bit = 0; bit < bits; ++bit)
+            if (i & (1 << bit))
+                reversed |= 1 << (bits - 1 - bit);
+        m_reversed[i] = reversed;
+    }
+    for (int32_t i = 0; i < size / 2; ++i) {
+        const double angle = -2.0 * std::numbers::pi * i / size;
+        m_twiddles[i] = { static_cast<float>(std::cos(angle)), static_cast<float>(std::sin(angle)) };
+    }
+}
+
+void Fft::transform(std::complex<float>* data, const bool inverse) const
+{
+    for (int32_t i = 0; i < m_size; ++i)
+        if (i < m_reversed[i])
+            std::swap(data[i], data[m_reversed[i]]);
+    const float sign = inverse ? -1.0f : 1.0f;
+    for (int32_t length = 2; length <= m_size; length *= 2) {
+        const int32_t half = length / 2;
+        const int32_t step = m_size / length;
+        for (int32_t start = 0; start < m_size; start += length)
+            for (int32_t j = 0; j < half; ++j) {
+                const float w_re = m_twiddles[j * step].real();
+                const float w_im = sign * m_twiddles[j * step].imag();
+                const std::complex<float> u = data[start + j];
+                const std::complex<float> v = data[start + j + half];
+                const float t_re = v.real() * w_re - v.imag() * w_im;
+                const float t_im = v.real() * w_im + v.imag() * w_re;
+                data[start + j] = { u.real() + t_re, u.imag() + t_im };
+                data[start + j + half] = { u.real() - t_re, u.imag() - t_im };
+            }
+    }
+}
+
+void Fft::transform_2d(std::complex<float>* data, const bool inverse, std::complex<float>* column) const
+{
+    for (int32_t row = 0; row < m_size; ++row)
+        transform(data + row * m_size, inverse);
+    for (int32_t col = 0; col < m_size; ++col) {
+        for (int32_t row = 0; row < m_size; ++row)
+            column[row] = data[row * m_size + col];
+        transform(column, inverse);
+        for (int32_t row = 0; row < m_size; ++row)
+            data[row * m_size + col] = column[row];
+    }
+}
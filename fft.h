@@ -0,0 +1,27 @@
+#pragma once
+
+#ifndef FFT_H
+#define FFT_H
+
+#include <complex>
+#include <cstdint>
+#include <vector>
+
+// Iterative radix-2 transform of a fixed power of two size; results are not normalized.
+class Fft {
+    int32_t m_size;
+    std::vector<int32_t> m_reversed;
+    std::vector<std::complex<float> > m_twiddles;
+
+public:
+    // CREATORS
+    explicit Fft(int32_t size);
+
+    // ACCESSORS
+    [[nodiscard]] int32_t size() const { return m_size; }
+    void transform(std::complex<float>* data, bool inverse) const;
+    // Square size x size transform, row major; `column` is scratch of at least size elements.
+    void transform_2d(std::complex<float>* data, bool inverse, std::complex<float>* column) const;
+};
+
+#endif //FFT_H
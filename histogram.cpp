@@ -0,0 +1,179 @@
+#include "histogram.h"
+
+#include "parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <mutex>
+#include <vector>
+
+static constexpr size_t block_size = 1 << 16;
+static constexpr int32_t interleave = 4;
+
+ChannelStatistics::ChannelStatistics()
+    : min(0), max(0), mean(0), variance(0)
+{
+}
+
+ChannelStatistics::ChannelStatistics(const ChannelHistogram& histogram)
+    : ChannelStatistics()
+{
+    uint64_t count = 0;
+    double sum = 0;
+    for (int32_t value = 0; value < 256; ++value) {
+        count += histogram[value];
+        sum += static_cast<double>(histogram[value]) * value;
+    }
+    if (count == 0)
+        return;
+    while (histogram[min] == 0)
+        ++min;
+    max = 255;
+    while (histogram[max] == 0)
+        --max;
+    mean = sum / count;
+    double squares = 0;
+    for (int32_t value = min; value <= max; ++value)
+        squares += static_cast<double>(histogram[value]) * (value - mean) * (value - mean);
+    variance = squares / count;
+}
+
+// Consecutive pixels count into one of `interleave` copies, so runs of equal values don't serialize on the
+// store-to-load forwarding of a single counter.
+template <int32_t Channels>
+static void count_pixels(const uint8_t* pixels, const size_t first, const size_t last, uint32_t* counts)
+{
+    size_t i = first;
+    for (; i + interleave <= last; i += interleave)
+        for (int32_t copy = 0; copy < interleave; ++copy) {
+            const uint8_t* pixel = pixels + (i + copy) * Channels;
+            for (int32_t channel = 0; channel < Channels; ++channel)
+                ++counts[(channel * interleave + copy) * 256 + pixel[channel]];
+        }
+    for (; i < last; ++i)
+        for (int32_t channel = 0; channel < Channels; ++channel)
+            ++counts[channel * interleave * 256 + pixels[i * Channels + channel]];
+}
+
+void build_histograms(const uint8_t* pixels, const size_t pixel_count, const int32_t channels,
+    ChannelHistogram* histograms)
+{
+    if (channels < 1 || 4 < channels)
+        throw std::exception();
+    for (int32_t channel = 0; channel < channels; ++channel)
+        histograms[channel].fill(0);
+    std::mutex merge;
+    const auto blocks = static_cast<int32_t>((pixel_count + block_size - 1) / block_size);
+    parallel_bands(blocks, [&](const int32_t begin, const int32_t end) {
+        std::vector<uint32_t> counts(static_cast<size_t>(channels) * interleave * 256, 0);
+        const size_t first = begin * block_size;
+        const size_t last = std::min(end * block_size, pixel_count);
+        switch (channels) {
+        case 1:
+            count_pixels<1>(pixels, first, last, counts.data());
+            break;
+        case 2:
+            count_pixels<2>(pixels, first, last, counts.data());
+            break;
+        case 3:
+            count_pixels<3>(pixels, first, last, counts.data());
+            break;
+        default:
+            count_pixels<4>(pixels, first, last, counts.data());
+            break;
+        }
+        const std::lock_guard lock(merge);
+        for (int32_t channel = 0; channel < channels; ++channel)
+            for (int32_t copy = 0; copy < interleave; ++copy)
+                for (int32_t value = 0; value < 256; ++value)
+                    histograms[channel][value] += counts[(channel * interleave + copy) * 256 + value];
+    }, 1);
+}
+
+template <int32_t Channels>
+static void lookup_pixels(uint8_t* pixels, const size_t first, const size_t last, const Lut* luts)
+{
+    for (size_t i = first; i < last; ++i)
+        for (int32_t channel = 0; channel < Channels; ++channel)
+            pixels[i * Channels + channel] = luts[channel][pixels[i * Channels + channel]];
+}
+
+void apply_luts(uint8_t* pixels, const size_t pixel_count, const int32_t channels, const Lut* luts)
+{
+    if (channels < 1 || 4 < channels)
+        throw std::exception();
+    const auto blocks = static_cast<int32_t>((pixel_count + block_size - 1) / block_size);
+    parallel_bands(blocks, [&](const int32_t begin, const int32_t end) {
+        const size_t first = begin * block_size;
+        const size_t last = std::min(end * block_size, pixel_count);
+        switch (channels) {
+        case 1:
+            lookup_pixels<1>(pixels, first, last, luts);
+            break;
+        case 2:
+            lookup_pixels<2>(pixels, first, last, luts);
+            break;
+        case 3:
+            lookup_pixels<3>(pixels, first, last, luts);
+            break;
+        default:
+            lookup_pixels<4>(pixels, first, last, luts);
+            break;
+        }
+    }, 1);
+}
+
+Lut make_identity_lut()
+{
+    Lut result;
+    for (int32_t value = 0; value < 256; ++value)
+        result[value] = static_cast<uint8_t>(value);
+    return result;
+}
+
+Lut make_equalize_lut(const ChannelHistogram& histogram)
+{
+    uint64_t total = 0;
+    for (const uint64_t count : histogram)
+        total += count;
+    int32_t first = 0;
+    while (first < 256 && histogram[first] == 0)
+        ++first;
+    if (first == 256 || histogram[first] == total)
+        return make_identity_lut();
+    const uint64_t cdf_min = histogram[first];
+    const double scale = 255.0 / static_cast<double>(total - cdf_min);
+    Lut result{};
+    uint64_t cdf = 0;
+    for (int32_t value = 0; value < 256; ++value) {
+        cdf += histogram[value];
+        if (value < first)
+            continue;
+        result[value] = static_cast<uint8_t>(std::lround(static_cast<double>(cdf - cdf_min) * scale));
+    }
+    return result;
+}
+
+Lut make_levels_lut(const ChannelHistogram& histogram, const double clip_fraction)
+{
+    uint64_t total = 0;
+    for (const uint64_t count : histogram)
+        total += count;
+    const double clip = clip_fraction * static_cast<double>(total);
+    int32_t low = 0;
+    uint64_t below = histogram[0];
+    while (low < 255 && static_cast<double>(below) <= clip)
+        below += histogram[++low];
+    int32_t high = 255;
+    uint64_t above = histogram[255];
+    while (0 < high && static_cast<double>(above) <= clip)
+        above += histogram[--high];
+    if (high <= low)
+        return make_identity_lut();
+    Lut result;
+    const double scale = 255.0 / (high - low);
+    for (int32_t value = 0; value < 256; ++value)
+        result[value] = static_cast<uint8_t>(std::clamp(std::lround((value - low) * scale), 0L, 255L));
+    return result;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+using ChannelHistogram = std::array<uint64_t, 256>;
+using Lut = std::array<uint8_t, 256>;
+
+struct ChannelStatistics {
+    uint8_t min;
+    uint8_t max;
+    double mean;
+    double variance;
+
+    ChannelStatistics();
+    explicit ChannelStatistics(const ChannelHistogram& histogram);
+};
+
+// Fills one histogram per channel of the interleaved pixels.
+void build_histograms(const uint8_t* pixels, size_t pixel_count, int32_t channels, ChannelHistogram* histograms);
+void apply_luts(uint8_t* pixels, size_t pixel_count, int32_t channels, const Lut* luts);
+Lut make_identity_lut();
+Lut make_equalize_lut(const ChannelHistogram& histogram);
+Lut make_levels_lut(const ChannelHistogram& histogram, double clip_fraction);
+
+#endif //HISTOGRAM_H
@@ -0,0 +1,580 @@
+#include "inflate.h"
+
+#include "checksum.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+// A table entry packs the code length in bits 0-3, the flags in bits 4-7, the number of extra bits in bits 8-15
+// and the literal, base value or subtable offset in bits 16-31. A subtable entry keeps the number of primary
+// bits as its length and the number of subtable bits as its extra bits.
+static constexpr uint32_t s_literal = 0x10;
+static constexpr uint32_t s_subtable = 0x20;
+static constexpr uint32_t s_end_of_block = 0x40;
+static constexpr uint32_t s_invalid = 0x80;
+
+static constexpr int32_t s_litlen_bits = 10;
+static constexpr int32_t s_distance_bits = 8;
+static constexpr int32_t s_code_length_bits = 7;
+static constexpr int32_t s_max_code_length = 15;
+// Word copies may write this far past the end of a match.
+static constexpr size_t s_slack = 8;
+
+static constexpr uint32_t make_entry(const uint32_t base, const uint32_t extra, const uint32_t flags)
+{
+    return base << 16 | extra << 8 | flags;
+}
+
+static constexpr std::array<uint32_t, 288> make_litlen_entries()
+{
+    constexpr uint16_t base[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83,
+        99, 115, 131, 163, 195, 227, 258 };
+    constexpr uint8_t extra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5,
+        5, 5, 0 };
+    std::array<uint32_t, 288> result = {};
+    for (uint32_t symbol = 0; symbol < 256; ++symbol)
+        result[symbol] = make_entry(symbol, 0, s_literal);
+    result[256] = make_entry(0, 0, s_end_of_block);
+    for (uint32_t symbol = 257; symbol < 286; ++symbol)
+        result[symbol] = make_entry(base[symbol - 257], extra[symbol - 257], 0);
+    result[286] = result[287] = make_entry(0, 0, s_invalid);
+    return result;
+}
+
+static constexpr std::array<uint32_t, 32> make_distance_entries()
+{
+    constexpr uint16_t base[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+        1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+    std::array<uint32_t, 32> result = {};
+    for (uint32_t symbol = 0; symbol < 30; ++symbol)
+        result[symbol] = make_entry(base[symbol], symbol < 4 ? 0 : symbol / 2 - 1, 0);
+    result[30] = result[31] = make_entry(0, 0, s_invalid);
+    return result;
+}
+
+static constexpr std::array<uint32_t, 19> make_code_length_entries()
+{
+    std::array<uint32_t, 19> result = {};
+    for (uint32_t symbol = 0; symbol < 19; ++symbol)
+        result[symbol] = make_entry(symbol, 0, 0);
+    return result;
+}
+
+static constexpr std::array<uint32_t, 288> s_litlen_entries = make_litlen_entries();
+static constexpr std::array<uint32_t, 32> s_distance_entries = make_distance_entries();
+static constexpr std::array<uint32_t, 19> s_code_length_entries = make_code_length_entries();
+
+struct HuffmanTable {
+    int32_t primary_bits;
+    std::vector<uint32_t> entries;
+};
+
+static uint32_t reverse_bits(uint32_t code, const int32_t length)
+{
+    uint32_t result = 0;
+    for (int32_t i = 0; i < length; ++i) {
+        result = result << 1 | (code & 1);
+        code >>= 1;
+    }
+    return result;
+}
+
+// Canonical Huffman decoding table. Codes up to `primary_bits` long are looked up with one index of the next
+// input bits, as DEFLATE stores codes starting at their first bit; longer codes go through a second level
+// table per primary prefix, sized for the longest code sharing that prefix. Incomplete codes are allowed and
+// their unused entries decode as invalid.
+static void build_table(const uint8_t* lengths, const int32_t count, const uint32_t* symbol_entries,
+    const int32_t primary_bits, HuffmanTable& table)
+{
+    std::array<int32_t, s_max_code_length + 1> counts = {};
+    for (int32_t symbol = 0; symbol < count; ++symbol)
+        ++counts[lengths[symbol]];
+    counts[0] = 0;
+    int32_t left = 1;
+    for (int32_t length = 1; length <= s_max_code_length; ++length) {
+        left = (left << 1) - counts[length];
+        if (left < 0)
+            throw std::exception();
+    }
+    std::array<uint32_t, s_max_code_length + 1> next_code = {};
+    for (int32_t length = 1; length <= s_max_code_length; ++length)
+        next_code[length] = (next_code[length - 1] + counts[length - 1]) << 1;
+    const uint32_t primary_size = 1u << primary_bits;
+    const uint32_t primary_mask = primary_size - 1;
+    std::array<uint32_t, 288> codes = {};
+    std::array<uint8_t, 1u << s_litlen_bits> longest = {};
+    for (int32_t symbol = 0; symbol < count; ++symbol) {
+        const int32_t length = lengths[symbol];
+        if (length == 0)
+            continue;
+        codes[symbol] = reverse_bits(next_code[length]++, length);
+        uint8_t& prefix_longest = longest[codes[symbol] & primary_mask];
+        prefix_longest = std::max(prefix_longest, static_cast<uint8_t>(length));
+    }
+    table.primary_bits = primary_bits;
+    table.entries.assign(primary_size, s_invalid);
+    for (uint32_t prefix = 0; prefix < primary_size; ++prefix) {
+        if (longest[prefix] <= primary_bits)
+            continue;
+        const uint32_t sub_bits = longest[prefix] - primary_bits;
+        table.entries[prefix] = make_entry(static_cast<uint32_t>(table.entries.size()), sub_bits, s_subtable)
+            | primary_bits;
+        table.entries.resize(table.entries.size() + (1u << sub_bits), s_invalid);
+    }
+    for (int32_t symbol = 0; symbol < count; ++symbol) {
+        const int32_t length = lengths[symbol];
+        if (length == 0)
+            continue;
+        const uint32_t code = codes[symbol];
+        if (length <= primary_bits) {
+            for (uint32_t index = code; index < primary_size; index += 1u << length)
+                table.entries[index] = symbol_entries[symbol] | length;
+            continue;
+        }
+        const uint32_t pointer = table.entries[code & primary_mask];
+        const uint32_t offset = pointer >> 16;
+        const uint32_t sub_size = 1u << (pointer >> 8 & 0xff);
+        const int32_t rest = length - primary_bits;
+        for (uint32_t index = code >> primary_bits; index < sub_size; index += 1u << rest)
+            table.entries[offset + index] = symbol_entries[symbol] | rest;
+    }
+}
+
+struct FixedTables {
+    HuffmanTable litlen;
+    HuffmanTable distance;
+
+    FixedTables()
+        : litlen(), distance()
+    {
+        std::array<uint8_t, 288> lengths = {};
+        std::fill(lengths.begin(), lengths.begin() + 144, 8);
+        std::fill(lengths.begin() + 144, lengths.begin() + 256, 9);
+        std::fill(lengths.begin() + 256, lengths.begin() + 280, 7);
+        std::fill(lengths.begin() + 280, lengths.end(), 8);
+        build_table(lengths.data(), 288, s_litlen_entries.data(), s_litlen_bits, litlen);
+        lengths.fill(5);
+        build_table(lengths.data(), 32, s_distance_entries.data(), s_distance_bits, distance);
+    }
+};
+
+static const FixedTables& fixed_tables()
+{
+    static const FixedTables tables;
+    return tables;
+}
+
+// Little-endian bit buffer. A refill tops it up to at least 56 bits, which covers a length code with its extra
+// bits and a distance code with its extra bits (48 bits), so the decode loop refills once per symbol. When the
+// current piece of input runs out the next one is pulled from `source`; past the end of the input it reads zero
+// bytes and counts them in `overrun`.
+struct BitReader {
+    const uint8_t* next;
+    const uint8_t* end;
+    const InflateSource* source;
+    uint64_t bits;
+    uint32_t count;
+    uint32_t overrun;
+
+    bool pull()
+    {
+        size_t size = 0;
+        while (size == 0) {
+            if (source == nullptr || !(*source)(next, size)) {
+                source = nullptr;
+                next = end;
+                return false;
+            }
+        }
+        end = next + size;
+        return true;
+    }
+
+    void refill()
+    {
+        if (8 <= end - next) {
+            uint64_t word;
+            std::memcpy(&word, next, 8);
+            bits |= word << count;
+            next += (63 - count) >> 3;
+            count |= 56;
+            return;
+        }
+        while (count < 56) {
+            if (next == end && !pull()) {
+                // More padding than the buffer holds means the stream ended early.
+                if (8 < ++overrun)
+                    throw std::exception();
+            }
+            else
+                bits |= static_cast<uint64_t>(*next++) << count;
+            count += 8;
+        }
+    }
+
+    uint32_t take(const uint32_t length)
+    {
+        const auto value = static_cast<uint32_t>(bits & ((uint64_t(1) << length) - 1));
+        bits >>= length;
+        count -= length;
+        return value;
+    }
+
+    uint32_t decode(const HuffmanTable& table)
+    {
+        const uint32_t* entries = table.entries.data();
+        uint32_t entry = entries[bits & ((1u << table.primary_bits) - 1)];
+        if (entry & s_subtable) {
+            bits >>= table.primary_bits;
+            count -= table.primary_bits;
+            entry = entries[(entry >> 16) + (bits & ((1u << (entry >> 8 & 0xff)) - 1))];
+        }
+        bits >>= entry & 0xf;
+        count -= entry & 0xf;
+        return entry;
+    }
+
+    // Base value plus the extra bits that follow the code.
+    uint32_t value(const uint32_t entry) { return (entry >> 16) + take(entry >> 8 & 0xff); }
+
+    // Bits that came from the input rather than from the zero padding.
+    [[nodiscard]] uint32_t real_count() const { return overrun * 8 < count ? count - overrun * 8 : 0; }
+
+    // Drops the bits up to the next byte boundary and makes sure `size` whole bytes of input are buffered.
+    void align_to_byte(const uint32_t size)
+    {
+        take(count & 7);
+        refill();
+        if (real_count() < size * 8)
+            throw std::exception();
+    }
+};
+
+// Decodes into `m_output`. Without a sink that is the whole result, grown as needed. With a sink it is a window
+// of 32K history plus room for new output, flushed and slid down whenever it fills up.
+class Inflater {
+    static constexpr size_t s_history = size_t(1) << 15;
+    static constexpr size_t s_window = 4 * s_history;
+
+    BitReader m_input;
+    const InflateSink* m_sink;
+    std::vector<uint8_t> m_output;
+    size_t m_position;
+    size_t m_flushed;
+    size_t m_limit;
+    size_t m_max_size;
+    uint64_t m_total;
+    ChecksumPolicy m_policy;
+    uint32_t m_adler;
+    HuffmanTable m_litlen;
+    HuffmanTable m_distance;
+
+public:
+    Inflater(const uint8_t* input, const size_t input_size, const size_t size_hint, const size_t max_size,
+        const ChecksumPolicy policy = ChecksumPolicy::Verify)
+        : m_input{ input, input + input_size, nullptr, 0, 0, 0 }, m_sink(nullptr), m_position(0), m_flushed(0)
+        , m_limit(std::min(size_hint, max_size)), m_max_size(max_size), m_total(0)
+        , m_policy(policy), m_adler(1), m_litlen(), m_distance()
+    {
+        m_output.resize(m_limit + s_slack);
+    }
+
+    Inflater(const InflateSource& source, const InflateSink& sink, const ChecksumPolicy policy)
+        : m_input{ nullptr, nullptr, &source, 0, 0, 0 }, m_sink(&sink), m_position(0), m_flushed(0)
+        , m_limit(s_window), m_max_size(SIZE_MAX), m_total(0), m_policy(policy), m_adler(1), m_litlen()
+        , m_distance()
+    {
+        m_output.resize(m_limit + s_slack);
+    }
+
+    // Decodes the zlib stream and handles its Adler-32 as the policy says.
+    InflateResult run()
+    {
+        m_input.refill();
+        const uint32_t method = m_input.take(4);
+        const uint32_t window_bits = m_input.take(4) + 8;
+        const uint32_t flags = m_input.take(8);
+        const bool preset_dictionary = (flags & 0x20) != 0;
+        const uint32_t check = (window_bits - 8) << 12 | method << 8 | flags;
+        if (method != 8 || 15 < window_bits || preset_dictionary || check % 31 != 0)
+            throw std::exception();
+        while (!inflate_block()) {
+        }
+        flush(m_position);
+        m_input.align_to_byte(4);
+        uint32_t expected = 0;
+        for (int32_t i = 0; i < 4; ++i)
+            expected = expected << 8 | m_input.take(8);
+        const bool valid = m_policy == ChecksumPolicy::Skip || m_adler == expected;
+        if (!valid && m_policy == ChecksumPolicy::Verify)
+            throw std::exception();
+        return { m_total, valid };
+    }
+
+    // Decodes raw deflate blocks until `size` bytes are out and returns their Adler-32; 1 under
+    // ChecksumPolicy::Skip.
+    uint32_t run_raw(const size_t size)
+    {
+        while (m_position < size && !inflate_block()) {
+        }
+        if (m_position != size)
+            throw std::exception();
+        flush(m_position);
+        return m_adler;
+    }
+
+    std::vector<uint8_t> take_output()
+    {
+        m_output.resize(m_position);
+        return std::move(m_output);
+    }
+
+private:
+    // Decodes one block; returns whether it was the last one.
+    bool inflate_block()
+    {
+        m_input.refill();
+        const bool last = m_input.take(1) != 0;
+        switch (m_input.take(2)) {
+        case 0:
+            copy_stored_block();
+            break;
+        case 1:
+            decode_block(fixed_tables().litlen, fixed_tables().distance);
+            break;
+        case 2:
+            read_dynamic_tables();
+            decode_block(m_litlen, m_distance);
+            break;
+        default:
+            throw std::exception();
+        }
+        return last;
+    }
+
+    // Hands the bytes up to `position` to the sink, if there is one, and adds them to the checksum.
+    void flush(const size_t position)
+    {
+        const uint8_t* data = m_output.data() + m_flushed;
+        const size_t size = position - m_flushed;
+        if (m_policy != ChecksumPolicy::Skip)
+            m_adler = adler32(m_adler, data, size);
+        if (m_sink != nullptr)
+            (*m_sink)(data, size);
+        m_total += size;
+        m_flushed = position;
+    }
+
+    // Makes room for `needed` more bytes after `out`, which is inside m_output, and returns it moved along.
+    [[gnu::noinline]] uint8_t* make_room(uint8_t* out, const size_t needed)
+    {
+        const size_t position = out - m_output.data();
+        if (m_sink != nullptr) {
+            flush(position);
+            const size_t keep = std::min(position, s_history);
+            std::copy(m_output.begin() + static_cast<ptrdiff_t>(position - keep),
+                m_output.begin() + static_cast<ptrdiff_t>(position), m_output.begin());
+            m_flushed = keep;
+            return m_output.data() + keep;
+        }
+        if (m_max_size - position < needed)
+            throw std::exception();
+        m_limit = std::min(std::max({ position + needed, m_limit * 2, size_t(1) << 16 }), m_max_size);
+        m_output.resize(m_limit + s_slack);
+        return m_output.data() + position;
+    }
+
+    // The length and its complement, then the bytes; the first few may still be in the bit buffer, the rest are
+    // copied straight from the input.
+    void copy_stored_block()
+    {
+        m_input.align_to_byte(4);
+        const uint32_t length = m_input.take(16);
+        if ((length ^ 0xffff) != m_input.take(16))
+            throw std::exception();
+        uint32_t left = length;
+        uint8_t* out = m_output.data() + m_position;
+        for (; left != 0 && 8 <= m_input.real_count(); --left) {
+            if (out == m_output.data() + m_limit)
+                out = make_room(out, left);
+            *out++ = static_cast<uint8_t>(m_input.take(8));
+        }
+        if (left != 0) {
+            // The buffer is empty, and the bits above `count` are the input bytes about to be copied.
+            if (m_input.overrun != 0)
+                throw std::exception();
+            m_input.bits = 0;
+            m_input.count = 0;
+        }
+        while (left != 0) {
+            if (m_input.next == m_input.end && !m_input.pull())
+                throw std::exception();
+            if (out == m_output.data() + m_limit)
+                out = make_room(out, left);
+            const size_t size = std::min({ static_cast<size_t>(left), static_cast<size_t>(m_input.end - m_input.next),
+                static_cast<size_t>(m_output.data() + m_limit - out) });
+            std::copy_n(m_input.next, size, out);
+            m_input.next += size;
+            out += size;
+            left -= static_cast<uint32_t>(size);
+        }
+        m_position = out - m_output.data();
+    }
+
+    void read_dynamic_tables()
+    {
+        static constexpr uint8_t order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+        m_input.refill();
+        const uint32_t litlen_count = m_input.take(5) + 257;
+        const uint32_t distance_count = m_input.take(5) + 1;
+        const uint32_t code_length_count = m_input.take(4) + 4;
+        if (286 < litlen_count || 30 < distance_count)
+            throw std::exception();
+        std::array<uint8_t, 19> code_lengths = {};
+        for (uint32_t i = 0; i < code_length_count; ++i) {
+            m_input.refill();
+            code_lengths[order[i]] = static_cast<uint8_t>(m_input.take(3));
+        }
+        HuffmanTable code_length_table;
+        build_table(code_lengths.data(), 19, s_code_length_entries.data(), s_code_length_bits, code_length_table);
+        std::array<uint8_t, 286 + 30> lengths = {};
+        const uint32_t total = litlen_count + distance_count;
+        for (uint32_t i = 0; i < total;) {
+            m_input.refill();
+            const uint32_t entry = m_input.decode(code_length_table);
+            if (entry & s_invalid)
+                throw std::exception();
+            const uint32_t symbol = entry >> 16;
+            if (symbol < 16) {
+                lengths[i++] = static_cast<uint8_t>(symbol);
+                continue;
+            }
+            uint8_t value = 0;
+            uint32_t repeat;
+            if (symbol == 16) {
+                if (i == 0)
+                    throw std::exception();
+                value = lengths[i - 1];
+                repeat = 3 + m_input.take(2);
+            }
+            else if (symbol == 17)
+                repeat = 3 + m_input.take(3);
+            else
+                repeat = 11 + m_input.take(7);
+            if (total - i < repeat)
+                throw std::exception();
+            std::fill_n(lengths.begin() + i, repeat, value);
+            i += repeat;
+        }
+        if (lengths[256] == 0)
+            throw std::exception();
+        build_table(lengths.data(), static_cast<int32_t>(litlen_count), s_litlen_entries.data(), s_litlen_bits,
+            m_litlen);
+        build_table(lengths.data() + litlen_count, static_cast<int32_t>(distance_count), s_distance_entries.data(),
+            s_distance_bits, m_distance);
+    }
+
+    // The hot loop keeps the bit buffer and output pointers in locals: stores through `out` may alias any member.
+    void decode_block(const HuffmanTable& litlen, const HuffmanTable& distance)
+    {
+        BitReader input = m_input;
+        uint8_t* begin = m_output.data();
+        uint8_t* out = begin + m_position;
+        uint8_t* limit = begin + m_limit;
+        for (;;) {
+            input.refill();
+            uint32_t entry = input.decode(litlen);
+            if (entry & s_literal) {
+                if (out == limit) {
+                    out = make_room(out, 1);
+                    begin = m_output.data();
+                    limit = begin + m_limit;
+                }
+                *out++ = static_cast<uint8_t>(entry >> 16);
+                // At least 41 bits are left, enough for one more code.
+                entry = input.decode(litlen);
+                if (entry & s_literal) {
+                    if (out == limit) {
+                        out = make_room(out, 1);
+                        begin = m_output.data();
+                        limit = begin + m_limit;
+                    }
+                    *out++ = static_cast<uint8_t>(entry >> 16);
+                    continue;
+                }
+                input.refill();
+            }
+            if (entry & (s_end_of_block | s_invalid)) {
+                if (entry & s_invalid)
+                    throw std::exception();
+                break;
+            }
+            const uint32_t length = input.value(entry);
+            entry = input.decode(distance);
+            if (entry & s_invalid)
+                throw std::exception();
+            const uint32_t offset = input.value(entry);
+            if (static_cast<size_t>(out - begin) < offset)
+                throw std::exception();
+            if (static_cast<size_t>(limit - out) < length) {
+                out = make_room(out, length);
+                begin = m_output.data();
+                limit = begin + m_limit;
+            }
+            copy_match(out, offset, length);
+            out += length;
+        }
+        m_input = input;
+        m_position = out - begin;
+    }
+
+    // Copies 8 bytes at a time, up to 7 bytes past the end of the match. A distance under 8 repeats a pattern
+    // that is stored from a word built once, advancing by the largest multiple of the distance that fits.
+    static void copy_match(uint8_t* out, const uint32_t offset, const uint32_t length)
+    {
+        uint8_t* end = out + length;
+        const uint8_t* src = out - offset;
+        if (offset == 1) {
+            std::memset(out, *src, length);
+            return;
+        }
+        if (offset < 8) {
+            uint8_t pattern[8];
+            for (uint32_t i = 0; i < 8; ++i)
+                pattern[i] = src[i % offset];
+            const uint32_t step = offset * (8 / offset);
+            for (; out < end; out += step)
+                std::memcpy(out, pattern, 8);
+            return;
+        }
+        while (out < end) {
+            uint64_t word;
+            std::memcpy(&word, src, 8);
+            std::memcpy(out, &word, 8);
+            src += 8;
+            out += 8;
+        }
+    }
+};
+
+std::vector<uint8_t> zlib_decompress(const uint8_t* input, const size_t input_size, const size_t size_hint,
+    const size_t max_size)
+{
+    Inflater inflater(input, input_size, size_hint, max_size);
+    inflater.run();
+    return inflater.take_output();
+}
+
+InflateResult zlib_decompress(const InflateSource& source, const InflateSink& sink, const ChecksumPolicy policy)
+{
+    return Inflater(source, sink, policy).run();
+}
+
+std::vector<uint8_t> inflate_raw(const uint8_t* input, const size_t input_size, const size_t output_size,
+    const ChecksumPolicy policy, uint32_t& adler)
+{
+    Inflater inflater(input, input_size, output_size, output_size, policy);
+    adler = inflater.run_raw(output_size);
+    return inflater.take_output();
+}
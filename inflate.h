@@ -0,0 +1,41 @@
+#pragma once
+
+#ifndef INFLATE_H
+#define INFLATE_H
+
+#include "checksum.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Gives the next piece of compressed input in `data` and `size`; returns false once the input has ended.
+using InflateSource = std::function<bool(const uint8_t*& data, size_t& size)>;
+// Receives the decompressed bytes in order; `data` is only valid during the call.
+using InflateSink = std::function<void(const uint8_t* data, size_t size)>;
+
+// Decompresses a zlib stream (RFC 1950), checking its header and Adler-32. The output starts at `size_hint` bytes
+// and may grow up to `max_size`. Throws std::exception when the stream is corrupt, truncated or larger than
+// `max_size`.
+std::vector<uint8_t> zlib_decompress(const uint8_t* input, size_t input_size, size_t size_hint = 0,
+    size_t max_size = SIZE_MAX);
+struct InflateResult {
+    uint64_t size;
+    // False only when the Adler-32 didn't match under ChecksumPolicy::Defer.
+    bool checksum_valid;
+};
+
+// The same streaming: input is pulled from `source` piece by piece and output goes to `sink` through a 32K
+// history window, so neither side is ever held whole.
+InflateResult zlib_decompress(const InflateSource& source, const InflateSink& sink,
+    ChecksumPolicy policy = ChecksumPolicy::Verify);
+
+// Decompresses raw deflate data (RFC 1951) that starts on a block boundary and doesn't refer back past its start,
+// such as a piece of a zlib stream after a full flush, up to the end of the block that makes `output_size` bytes.
+// Their Adler-32 goes to `adler`, to be joined with adler32_combine, unless the policy is Skip. Throws
+// std::exception when the data is corrupt or the blocks overshoot `output_size`.
+std::vector<uint8_t> inflate_raw(const uint8_t* input, size_t input_size, size_t output_size, ChecksumPolicy policy,
+    uint32_t& adler);
+
+#endif //INFLATE_H
@@ -0,0 +1,204 @@
+#include "median.h"
+
+#include "cpu_dispatch.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <vector>
+
+struct Comparator {
+    uint8_t low;
+    uint8_t high;
+};
+
+// Batcher's odd-even merge sort network for any n.
+template <int32_t N, typename Visit>
+static constexpr void batcher_network(Visit&& visit)
+{
+    for (int32_t p = 1; p < N; p += p)
+        for (int32_t k = p; 1 <= k; k /= 2)
+            for (int32_t j = k % p; j + k < N; j += 2 * k)
+                for (int32_t i = 0; i < std::min(k, N - j - k); ++i)
+                    if ((i + j) / (2 * p) == (i + j + k) / (2 * p))
+                        visit(i + j, i + j + k);
+}
+
+template <int32_t N>
+static constexpr int32_t network_size()
+{
+    int32_t count = 0;
+    batcher_network<N>([&count](int32_t, int32_t) { ++count; });
+    return count;
+}
+
+template <int32_t N>
+static constexpr std::array<Comparator, network_size<N>()> make_network()
+{
+    std::array<Comparator, network_size<N>()> result{};
+    int32_t index = 0;
+    batcher_network<N>([&](const int32_t low, const int32_t high) {
+        result[index++] = { static_cast<uint8_t>(low), static_cast<uint8_t>(high) };
+    });
+    return result;
+}
+
+static void pad_row(const uint8_t* src, uint8_t* dst, const int32_t width, const int32_t channels,
+    const int32_t radius)
+{
+    for (int32_t col = -radius; col < width + radius; ++col) {
+        const int32_t clamped = std::clamp(col, 0, width - 1);
+        for (int32_t channel = 0; channel < channels; ++channel)
+            dst[(col + radius) * channels + channel] = src[clamped * channels + channel];
+    }
+}
+
+// Sorts blocks of `lanes` samples at once; every comparator is a lane wise min/max the compiler vectorizes.
+template <int32_t Radius>
+SIMD_INLINE void median_network_rows(const uint8_t* src, uint8_t* dst, const int32_t begin, const int32_t end,
+    const int32_t height, const int32_t width, const int32_t channels)
+{
+    constexpr int32_t diameter = 2 * Radius + 1;
+    constexpr int32_t count = diameter * diameter;
+    constexpr int32_t lanes = 32;
+    static constexpr auto network = make_network<count>();
+    const int32_t length = width * channels;
+    const int32_t padded_length = (width + 2 * Radius) * channels;
+    std::vector<uint8_t> rows(static_cast<size_t>(diameter) * padded_length);
+    auto load = [&](const int32_t row) {
+        const int32_t slot = ((row % diameter) + diameter) % diameter;
+        pad_row(src + static_cast<size_t>(std::clamp(row, 0, height - 1)) * length,
+            &rows[static_cast<size_t>(slot) * padded_length], width, channels, Radius);
+    };
+    for (int32_t row = begin - Radius; row < begin + Radius; ++row)
+        load(row);
+    alignas(64) uint8_t samples[count][lanes];
+    for (int32_t row = begin; row < end; ++row) {
+        load(row + Radius);
+        const uint8_t* window[diameter];
+        for (int32_t dy = 0; dy < diameter; ++dy) {
+            const int32_t slot = (((row - Radius + dy) % diameter) + diameter) % diameter;
+            window[dy] = &rows[static_cast<size_t>(slot) * padded_length];
+        }
+        uint8_t* dst_row = dst + static_cast<size_t>(row) * length;
+        for (int32_t block = 0; block < length; block += lanes) {
+            const int32_t active = std::min(lanes, length - block);
+            for (int32_t dy = 0; dy < diameter; ++dy)
+                for (int32_t dx = 0; dx < diameter; ++dx) {
+                    const uint8_t* source = window[dy] + block + dx * channels;
+                    uint8_t* sample = samples[dy * diameter + dx];
+                    for (int32_t lane = 0; lane < active; ++lane)
+                        sample[lane] = source[lane];
+                }
+            for (const Comparator& comparator : network) {
+                uint8_t low[lanes];
+                uint8_t high[lanes];
+                for (int32_t lane = 0; lane < lanes; ++lane) {
+                    low[lane] = std::min(samples[comparator.low][lane], samples[comparator.high][lane]);
+                    high[lane] = std::max(samples[comparator.low][lane], samples[comparator.high][lane]);
+                }
+                std::copy_n(low, lanes, samples[comparator.low]);
+                std::copy_n(high, lanes, samples[comparator.high]);
+            }
+            for (int32_t lane = 0; lane < active; ++lane)
+                dst_row[block + lane] = samples[count / 2][lane];
+        }
+    }
+}
+
+// Perreault and Hebert: one 256 bin histogram per column and channel slides down the band, the kernel
+// histogram slides right by adding the entering column and subtracting the leaving one.
+SIMD_INLINE void median_histogram_rows_body(const uint8_t* src, uint8_t* dst, const int32_t begin, const int32_t end,
+    const int32_t height, const int32_t width, const int32_t channels, const int32_t radius)
+{
+    constexpr int32_t bins = 256;
+    constexpr int32_t coarse_bins = 16;
+    const int32_t length = width * channels;
+    const int32_t rank = (2 * radius + 1) * (2 * radius + 1) / 2;
+    std::vector<uint16_t> columns(static_cast<size_t>(length) * bins, 0);
+    std::vector<uint16_t> columns_coarse(static_cast<size_t>(length) * coarse_bins, 0);
+    auto update_columns = [&](const int32_t row, const int32_t delta) {
+        const uint8_t* src_row = src + static_cast<size_t>(std::clamp(row, 0, height - 1)) * length;
+        for (int32_t i = 0; i < length; ++i) {
+            columns[static_cast<size_t>(i) * bins + src_row[i]] += delta;
+            columns_coarse[static_cast<size_t>(i) * coarse_bins + (src_row[i] >> 4)] += delta;
+        }
+    };
+    for (int32_t row = begin - radius - 1; row < begin + radius; ++row)
+        update_columns(row, 1);
+    std::vector<uint16_t> kernel(static_cast<size_t>(channels) * bins);
+    std::vector<uint16_t> kernel_coarse(static_cast<size_t>(channels) * coarse_bins);
+    auto add_column = [&](const int32_t col, const int32_t sign) {
+        const int32_t clamped = std::clamp(col, 0, width - 1);
+        for (int32_t channel = 0; channel < channels; ++channel) {
+            const size_t index = static_cast<size_t>(clamped) * channels + channel;
+            const uint16_t* fine = &columns[index * bins];
+            const uint16_t* coarse = &columns_coarse[index * coarse_bins];
+            uint16_t* kernel_fine = &kernel[static_cast<size_t>(channel) * bins];
+            uint16_t* kernel_rough = &kernel_coarse[static_cast<size_t>(channel) * coarse_bins];
+            if (0 < sign) {
+                for (int32_t bin = 0; bin < bins; ++bin)
+                    kernel_fine[bin] += fine[bin];
+                for (int32_t bin = 0; bin < coarse_bins; ++bin)
+                    kernel_rough[bin] += coarse[bin];
+            } else {
+                for (int32_t bin = 0; bin < bins; ++bin)
+                    kernel_fine[bin] -= fine[bin];
+                for (int32_t bin = 0; bin < coarse_bins; ++bin)
+                    kernel_rough[bin] -= coarse[bin];
+            }
+        }
+    };
+    for (int32_t row = begin; row < end; ++row) {
+        update_columns(row - radius - 1, -1);
+        update_columns(row + radius, 1);
+        std::fill(kernel.begin(), kernel.end(), 0);
+        std::fill(kernel_coarse.begin(), kernel_coarse.end(), 0);
+        for (int32_t col = -radius; col <= radius; ++col)
+            add_column(col, 1);
+        uint8_t* dst_row = dst + static_cast<size_t>(row) * length;
+        for (int32_t col = 0; col < width; ++col) {
+            if (col != 0) {
+                add_column(col - radius - 1, -1);
+                add_column(col + radius, 1);
+            }
+            for (int32_t channel = 0; channel < channels; ++channel) {
+                const uint16_t* kernel_rough = &kernel_coarse[static_cast<size_t>(channel) * coarse_bins];
+                int32_t sum = 0;
+                int32_t coarse = 0;
+                while (sum + kernel_rough[coarse] <= rank)
+                    sum += kernel_rough[coarse++];
+                const uint16_t* kernel_fine = &kernel[static_cast<size_t>(channel) * bins + coarse * coarse_bins];
+                int32_t fine = 0;
+                while (sum + kernel_fine[fine] <= rank)
+                    sum += kernel_fine[fine++];
+                dst_row[col * channels + channel] = static_cast<uint8_t>(coarse * coarse_bins + fine);
+            }
+        }
+    }
+}
+
+SIMD_DISPATCH(void, median_network_rows_1, median_network_rows<1>, (const uint8_t* src, uint8_t* dst,
+    const int32_t begin, const int32_t end, const int32_t height, const int32_t width, const int32_t channels),
+    (src, dst, begin, end, height, width, channels))
+SIMD_DISPATCH(void, median_network_rows_2, median_network_rows<2>, (const uint8_t* src, uint8_t* dst,
+    const int32_t begin, const int32_t end, const int32_t height, const int32_t width, const int32_t channels),
+    (src, dst, begin, end, height, width, channels))
+SIMD_DISPATCH(void, median_histogram_rows, median_histogram_rows_body, (const uint8_t* src, uint8_t* dst,
+    const int32_t begin, const int32_t end, const int32_t height, const int32_t width, const int32_t channels,
+    const int32_t radius), (src, dst, begin, end, height, width, channels, radius))
+
+void median_filter(const uint8_t* src, uint8_t* dst, const int32_t height, const int32_t width,
+    const int32_t channels, const int32_t radius)
+{
+    assert(0 < radius && radius < 128 && "out of range radius");
+    parallel_bands(height, [&](const int32_t begin, const int32_t end) {
+        if (radius == 1)
+            median_network_rows_1(src, dst, begin, end, height, width, channels);
+        else if (radius == 2)
+            median_network_rows_2(src, dst, begin, end, height, width, channels);
+        else
+            median_histogram_rows(src, dst, begin, end, height, width, channels, radius);
+    }, std::max(16, 4 * radius));
+}
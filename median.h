@@ -0,0 +1,12 @@
+#pragma once
+
+#ifndef MEDIAN_H
+#define MEDIAN_H
+
+#include <cstdint>
+
+// Per channel median over a (2 * radius + 1)^2 window with edge pixels replicated; src and dst must not alias. The
+// radius is below 128, so that the 16-bit histogram counts of a window can't overflow.
+void median_filter(const uint8_t* src, uint8_t* dst, int32_t height, int32_t width, int32_t channels, int32_t radius);
+
+#endif //MEDIAN_H
@@ -0,0 +1,116 @@
+#pragma once
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+inline int32_t thread_count()
+{
+    static const int32_t count = std::max(1u, std::thread::hardware_concurrency());
+    return count;
+}
+
+// Splits [0, count) into contiguous bands and runs function(begin, end) for each band on its own thread.
+template <typename Function>
+void parallel_bands(const int32_t count, Function&& function, const int32_t min_band = 16)
+{
+    const int32_t bands = std::clamp(count / std::max(min_band, 1), 1, thread_count());
+    if (bands == 1) {
+        function(0, count);
+        return;
+    }
+    std::vector<std::thread> threads;
+    threads.reserve(bands - 1);
+    for (int32_t band = 0; band < bands - 1; ++band)
+        threads.emplace_back([&function, band, bands, count] {
+            function(count * band / bands, count * (band + 1) / bands);
+        });
+    function(count * (bands - 1) / bands, count);
+    for (std::thread& thread : threads)
+        thread.join();
+}
+
+// A bounded queue between one producer and one consumer thread, over a ring of `capacity` reusable slots. The
+// two indices are the only shared state; a side that has to wait for the other sleeps on the index it waits for.
+// Either side can end the exchange: close() after the producer's last slot, cancel() when the consumer gives up.
+template <typename T>
+class SpscRing {
+    static constexpr size_t s_ended = size_t(1) << (sizeof(size_t) * 8 - 1);
+
+    std::vector<T> m_slots;
+    // Slots taken by the consumer and published by the producer; s_ended is set by cancel() and close().
+    alignas(64) std::atomic<size_t> m_head;
+    alignas(64) std::atomic<size_t> m_tail;
+
+public:
+    // CREATORS
+    explicit SpscRing(const size_t capacity)
+        : m_slots(capacity), m_head(0), m_tail(0)
+    {
+    }
+
+    // MANIPULATORS
+    // Producer: the slot to fill next, once the consumer has made room; nullptr after cancel().
+    T* acquire()
+    {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        for (;;) {
+            const size_t head = m_head.load(std::memory_order_acquire);
+            if (head & s_ended)
+                return nullptr;
+            if (tail - head < m_slots.size())
+                return &m_slots[tail % m_slots.size()];
+            m_head.wait(head, std::memory_order_acquire);
+        }
+    }
+
+    // Producer: hands the acquired slot to the consumer.
+    void publish()
+    {
+        m_tail.fetch_add(1, std::memory_order_release);
+        m_tail.notify_one();
+    }
+
+    // Producer: no more slots follow.
+    void close()
+    {
+        m_tail.fetch_or(s_ended, std::memory_order_release);
+        m_tail.notify_one();
+    }
+
+    // Consumer: the oldest published slot, once there is one; nullptr when they have all been taken after close().
+    T* front()
+    {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        for (;;) {
+            const size_t tail = m_tail.load(std::memory_order_acquire);
+            if (head != (tail & ~s_ended))
+                return &m_slots[head % m_slots.size()];
+            if (tail & s_ended)
+                return nullptr;
+            m_tail.wait(tail, std::memory_order_acquire);
+        }
+    }
+
+    // Consumer: gives the slot front() returned back to the producer.
+    void pop()
+    {
+        m_head.fetch_add(1, std::memory_order_release);
+        m_head.notify_one();
+    }
+
+    // Consumer: stops the producer; acquire() fails from now on.
+    void cancel()
+    {
+        m_head.fetch_or(s_ended, std::memory_order_release);
+        m_head.notify_one();
+    }
+};
+
+#endif //PARALLEL_H
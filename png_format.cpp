@@ -0,0 +1,386 @@
+#include "png_format.h"
+
+#include "cpu_dispatch.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define PNG_FORMAT_SSE
+#endif
+
+// Moves bytes pixel by pixel: output byte k of a pixel is input byte map[k] of that pixel, or 255 for -1.
+struct ByteShuffle {
+    size_t in;
+    size_t out;
+    int8_t map[4];
+};
+
+static constexpr ByteShuffle s_grey_to_rgb = { 1, 3, { 0, 0, 0 } };
+static constexpr ByteShuffle s_grey_to_rgba = { 1, 4, { 0, 0, 0, -1 } };
+static constexpr ByteShuffle s_grey_alpha_to_rgb = { 2, 3, { 0, 0, 0 } };
+static constexpr ByteShuffle s_grey_alpha_to_rgba = { 2, 4, { 0, 0, 0, 1 } };
+static constexpr ByteShuffle s_rgb_to_rgba = { 3, 4, { 0, 1, 2, -1 } };
+static constexpr ByteShuffle s_rgba_to_rgb = { 4, 3, { 0, 1, 2 } };
+
+static bool sse_supported()
+{
+    static const bool supported = simd_level() != SimdLevel::Scalar;
+    return supported;
+}
+
+#ifdef PNG_FORMAT_SSE
+SIMD_TARGET_SSE41 static void store_partial(uint8_t* dst, const __m128i value, const size_t size)
+{
+    if (size == 16) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), value);
+        return;
+    }
+    size_t done = 0;
+    if (8 <= size) {
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst), value);
+        done = 8;
+    }
+    if (size - done == 4) {
+        const __m128i rest = done == 8 ? _mm_srli_si128(value, 8) : value;
+        const auto bytes = static_cast<uint32_t>(_mm_cvtsi128_si32(rest));
+        std::memcpy(dst + done, &bytes, 4);
+    }
+}
+
+// Every 16 input bytes that hold whole pixels go through one pshufb per 16 output bytes. Returns the pixels done.
+template <ByteShuffle Shuffle>
+SIMD_TARGET_SSE41 static size_t shuffle_pixels_sse(const uint8_t* src, const size_t count, uint8_t* dst)
+{
+    constexpr size_t pixels = 16 / Shuffle.in;
+    constexpr size_t out_bytes = pixels * Shuffle.out;
+    constexpr size_t chunks = (out_bytes + 15) / 16;
+    alignas(16) int8_t indices[chunks][16];
+    alignas(16) int8_t opaque[chunks][16];
+    for (size_t k = 0; k < chunks * 16; ++k) {
+        const int8_t index = Shuffle.map[k % Shuffle.out];
+        const bool used = k < out_bytes;
+        indices[k / 16][k % 16] = !used || index < 0 ? -1
+            : static_cast<int8_t>(k / Shuffle.out * Shuffle.in + index);
+        opaque[k / 16][k % 16] = used && index < 0 ? -1 : 0;
+    }
+    __m128i masks[chunks];
+    __m128i alphas[chunks];
+    for (size_t chunk = 0; chunk < chunks; ++chunk) {
+        masks[chunk] = _mm_load_si128(reinterpret_cast<const __m128i*>(indices[chunk]));
+        alphas[chunk] = _mm_load_si128(reinterpret_cast<const __m128i*>(opaque[chunk]));
+    }
+    size_t i = 0;
+    for (; i * Shuffle.in + 16 <= count * Shuffle.in; i += pixels) {
+        const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * Shuffle.in));
+        uint8_t* out = dst + i * Shuffle.out;
+        for (size_t chunk = 0; chunk < chunks; ++chunk)
+            store_partial(out + chunk * 16, _mm_or_si128(_mm_shuffle_epi8(x, masks[chunk]), alphas[chunk]),
+                std::min<size_t>(16, out_bytes - chunk * 16));
+    }
+    return i;
+}
+
+// Splits every byte into its samples, most significant first, by halving them step by step (bytes into nibbles,
+// nibbles into pairs of bits, pairs into bits) with shifts, masks and byte interleaves, then maps every sample
+// through `lut`. Returns the samples done.
+template <int32_t Depth>
+SIMD_TARGET_SSE41 static size_t unpack_samples_sse(const uint8_t* src, const size_t count, uint8_t* dst,
+    const uint8_t* lut)
+{
+    constexpr size_t per_byte = 8 / Depth;
+    const __m128i table = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lut));
+    size_t i = 0;
+    for (; (i + 16) * per_byte <= count; i += 16) {
+        __m128i parts[per_byte];
+        parts[0] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        size_t used = 1;
+        for (int32_t bits = 4; Depth <= bits; bits /= 2) {
+            const __m128i mask = _mm_set1_epi8(static_cast<char>((1 << bits) - 1));
+            for (size_t k = used; k-- != 0;) {
+                const __m128i high = _mm_and_si128(_mm_srli_epi16(parts[k], bits), mask);
+                const __m128i low = _mm_and_si128(parts[k], mask);
+                parts[2 * k + 1] = _mm_unpackhi_epi8(high, low);
+                parts[2 * k] = _mm_unpacklo_epi8(high, low);
+            }
+            used *= 2;
+        }
+        for (size_t k = 0; k < per_byte; ++k)
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * per_byte + k * 16),
+                _mm_shuffle_epi8(table, parts[k]));
+    }
+    return i * per_byte;
+}
+
+// Big endian 16-bit samples to round(v / 257) as (t - (t >> 8)) >> 8 with t = v + 128, saturated; exact for every v.
+SIMD_TARGET_SSE41 static size_t scale_down_16_sse(const uint8_t* src, const size_t count, uint8_t* dst)
+{
+    const __m128i swap = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    const __m128i half = _mm_set1_epi16(128);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i low = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 2)), swap);
+        __m128i high = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 2 + 16)), swap);
+        low = _mm_adds_epu16(low, half);
+        high = _mm_adds_epu16(high, half);
+        low = _mm_srli_epi16(_mm_sub_epi16(low, _mm_srli_epi16(low, 8)), 8);
+        high = _mm_srli_epi16(_mm_sub_epi16(high, _mm_srli_epi16(high, 8)), 8);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(low, high));
+    }
+    return i;
+}
+
+// Eight indices per gather of RGBA entries; RGB keeps the first three bytes of each. Returns the pixels done.
+template <int32_t OutChannels>
+SIMD_TARGET_AVX2 static size_t palette_lookup_avx2(const uint8_t* indices, const size_t count, const uint8_t* palette,
+    uint8_t* dst)
+{
+    const __m256i drop_alpha = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+        0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    const auto* entries = reinterpret_cast<const int32_t*>(palette);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i index = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(indices + i)));
+        const __m256i rgba = _mm256_i32gather_epi32(entries, index, 4);
+        if constexpr (OutChannels == 4) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), rgba);
+        } else {
+            const __m256i rgb = _mm256_shuffle_epi8(rgba, drop_alpha);
+            uint8_t* out = dst + i * 3;
+            const __m128i second = _mm256_extracti128_si256(rgb, 1);
+            const __m128i first = _mm256_castsi256_si128(rgb);
+            const auto middle = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(first, 8)));
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(out), first);
+            std::memcpy(out + 8, &middle, 4);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(out + 12), second);
+            const auto last = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(second, 8)));
+            std::memcpy(out + 20, &last, 4);
+        }
+    }
+    return i;
+}
+#endif
+
+template <ByteShuffle Shuffle>
+static void shuffle_pixels(const uint8_t* src, const size_t count, uint8_t* dst)
+{
+    size_t i = 0;
+#ifdef PNG_FORMAT_SSE
+    if (sse_supported())
+        i = shuffle_pixels_sse<Shuffle>(src, count, dst);
+#endif
+    for (; i < count; ++i)
+        for (size_t k = 0; k < Shuffle.out; ++k)
+            dst[i * Shuffle.out + k] = Shuffle.map[k] < 0 ? 255 : src[i * Shuffle.in + Shuffle.map[k]];
+}
+
+template <int32_t Depth>
+static void unpack_samples(const uint8_t* src, const size_t count, uint8_t* dst, const uint8_t* lut)
+{
+    constexpr int32_t per_byte = 8 / Depth;
+    constexpr int32_t mask = (1 << Depth) - 1;
+    size_t i = 0;
+#ifdef PNG_FORMAT_SSE
+    if (sse_supported())
+        i = unpack_samples_sse<Depth>(src, count, dst, lut);
+#endif
+    for (; i < count; ++i)
+        dst[i] = lut[src[i / per_byte] >> (8 - Depth * (static_cast<int32_t>(i % per_byte) + 1)) & mask];
+}
+
+static void scale_down_16(const uint8_t* src, const size_t count, uint8_t* dst)
+{
+    size_t i = 0;
+#ifdef PNG_FORMAT_SSE
+    if (sse_supported())
+        i = scale_down_16_sse(src, count, dst);
+#endif
+    for (; i < count; ++i) {
+        const uint32_t value = std::min<uint32_t>(static_cast<uint32_t>(src[i * 2] << 8 | src[i * 2 + 1]) + 128, 65535);
+        dst[i] = static_cast<uint8_t>((value - (value >> 8)) >> 8);
+    }
+}
+
+template <int32_t OutChannels>
+static void palette_lookup(const uint8_t* indices, const size_t count, const uint8_t* palette, uint8_t* dst)
+{
+    size_t i = 0;
+#ifdef PNG_FORMAT_SSE
+    static const bool gather = simd_level() >= SimdLevel::Avx2;
+    if (gather)
+        i = palette_lookup_avx2<OutChannels>(indices, count, palette, dst);
+#endif
+    for (; i < count; ++i)
+        std::memcpy(dst + i * OutChannels, palette + indices[i] * 4, OutChannels);
+}
+
+void rgba_to_rgb(const uint8_t* rgba, const size_t count, uint8_t* rgb)
+{
+    shuffle_pixels<s_rgba_to_rgb>(rgba, count, rgb);
+}
+
+PngPixelFormat::PngPixelFormat(const uint8_t color_type, const uint8_t bit_depth)
+    : m_color_type(color_type), m_bit_depth(bit_depth), m_has_palette(false), m_has_transparency(false)
+    , m_transparent{}, m_palette{}
+{
+    if (!valid(color_type, bit_depth))
+        throw std::exception();
+    for (size_t i = 3; i < m_palette.size(); i += 4)
+        m_palette[i] = 255;
+}
+
+void PngPixelFormat::set_palette(const uint8_t* data, const size_t size)
+{
+    if (size == 0 || size % 3 != 0 || 256 * 3 < size)
+        throw std::exception();
+    for (size_t i = 0; i < size / 3; ++i)
+        std::copy_n(data + i * 3, 3, &m_palette[i * 4]);
+    m_has_palette = true;
+}
+
+void PngPixelFormat::set_transparency(const uint8_t* data, const size_t size)
+{
+    switch (m_color_type) {
+    case 0:
+    case 2:
+        if (size != static_cast<size_t>(channels()) * 2)
+            throw std::exception();
+        for (int32_t channel = 0; channel < channels(); ++channel)
+            m_transparent[channel] = static_cast<uint16_t>(data[channel * 2] << 8 | data[channel * 2 + 1]);
+        break;
+    case 3:
+        if (256 < size)
+            throw std::exception();
+        for (size_t i = 0; i < size; ++i)
+            m_palette[i * 4 + 3] = data[i];
+        break;
+    default:
+        // Images with an alpha channel don't have a tRNS chunk; ignore a stray one.
+        return;
+    }
+    m_has_transparency = true;
+}
+
+bool PngPixelFormat::valid(const uint8_t color_type, const uint8_t bit_depth)
+{
+    switch (color_type) {
+    case 0:
+        return bit_depth == 1 || bit_depth == 2 || bit_depth == 4 || bit_depth == 8 || bit_depth == 16;
+    case 3:
+        return bit_depth == 1 || bit_depth == 2 || bit_depth == 4 || bit_depth == 8;
+    case 2:
+    case 4:
+    case 6:
+        return bit_depth == 8 || bit_depth == 16;
+    default:
+        return false;
+    }
+}
+
+int32_t PngPixelFormat::channels() const
+{
+    static constexpr int32_t s_channels[7] = { 1, 0, 3, 1, 2, 0, 4 };
+    return s_channels[m_color_type];
+}
+
+size_t PngPixelFormat::bytes_per_pixel() const
+{
+    return std::max<size_t>(1, channels() * m_bit_depth / 8);
+}
+
+size_t PngPixelFormat::row_bytes(const size_t width) const
+{
+    return (width * channels() * m_bit_depth + 7) / 8;
+}
+
+bool PngPixelFormat::has_alpha() const
+{
+    return m_color_type == 4 || m_color_type == 6 || m_has_transparency;
+}
+
+void PngPixelFormat::expand_rgb(const uint8_t* row, const size_t width, uint8_t* rgb)
+{
+    expand<3>(row, width, rgb);
+}
+
+void PngPixelFormat::expand_rgba(const uint8_t* row, const size_t width, uint8_t* rgba)
+{
+    expand<4>(row, width, rgba);
+}
+
+template <int32_t OutChannels>
+void PngPixelFormat::expand(const uint8_t* row, const size_t width, uint8_t* out)
+{
+    assert((m_color_type != 3 || m_has_palette) && "palette image without PLTE");
+    const size_t count = width * channels();
+    const uint8_t* samples = row;
+    if (m_bit_depth != 8) {
+        m_samples.resize(count);
+        samples = m_samples.data();
+    }
+    if (m_bit_depth < 8) {
+        // Grey is scaled to full range on the way out, palette indices stay as they are.
+        uint8_t lut[16];
+        const int32_t scale = m_color_type == 0 ? 255 / ((1 << m_bit_depth) - 1) : 1;
+        for (int32_t i = 0; i < 16; ++i)
+            lut[i] = static_cast<uint8_t>(i * scale);
+        if (m_bit_depth == 1)
+            unpack_samples<1>(row, count, m_samples.data(), lut);
+        else if (m_bit_depth == 2)
+            unpack_samples<2>(row, count, m_samples.data(), lut);
+        else
+            unpack_samples<4>(row, count, m_samples.data(), lut);
+    } else if (m_bit_depth == 16) {
+        scale_down_16(row, count, m_samples.data());
+    }
+    switch (m_color_type) {
+    case 0:
+        shuffle_pixels<OutChannels == 4 ? s_grey_to_rgba : s_grey_to_rgb>(samples, width, out);
+        break;
+    case 2:
+        if constexpr (OutChannels == 4)
+            shuffle_pixels<s_rgb_to_rgba>(samples, width, out);
+        else
+            std::copy_n(samples, width * 3, out);
+        break;
+    case 3:
+        palette_lookup<OutChannels>(samples, width, m_palette.data(), out);
+        break;
+    case 4:
+        shuffle_pixels<OutChannels == 4 ? s_grey_alpha_to_rgba : s_grey_alpha_to_rgb>(samples, width, out);
+        break;
+    default:
+        if constexpr (OutChannels == 4)
+            std::copy_n(samples, width * 4, out);
+        else
+            shuffle_pixels<s_rgba_to_rgb>(samples, width, out);
+        break;
+    }
+    if (OutChannels == 4 && m_has_transparency && m_color_type != 3)
+        apply_transparent_key(row, width, out);
+}
+
+// Pixels whose samples equal the tRNS key, compared at the bit depth of the image, become fully transparent.
+void PngPixelFormat::apply_transparent_key(const uint8_t* row, const size_t width, uint8_t* rgba) const
+{
+    const int32_t count = channels();
+    const int32_t mask = (1 << std::min<int32_t>(m_bit_depth, 8)) - 1;
+    for (size_t i = 0; i < width; ++i) {
+        bool transparent = true;
+        for (int32_t channel = 0; channel < count; ++channel) {
+            const size_t sample = i * count + channel;
+            uint16_t value;
+            if (m_bit_depth == 16) {
+                value = static_cast<uint16_t>(row[sample * 2] << 8 | row[sample * 2 + 1]);
+            } else {
+                const size_t bit = sample * m_bit_depth;
+                value = static_cast<uint16_t>(row[bit / 8] >> (8 - m_bit_depth - bit % 8) & mask);
+            }
+            transparent = transparent && value == m_transparent[channel];
+        }
+        if (transparent)
+            rgba[i * 4 + 3] = 0;
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#ifndef PNG_FORMAT_H
+#define PNG_FORMAT_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// How a PNG stores its pixels, from the color type and bit depth of IHDR plus PLTE and tRNS, and the kernels that
+// turn its unfiltered scanlines into 8-bit RGB or RGBA. 16-bit samples are rounded to 8 bits, 1, 2 and 4-bit grey
+// is scaled to full range and palette indices are looked up.
+class PngPixelFormat {
+    uint8_t m_color_type;
+    uint8_t m_bit_depth;
+    bool m_has_palette;
+    bool m_has_transparency;
+    // The tRNS key of grey (first sample) and RGB images, at the bit depth of the image.
+    uint16_t m_transparent[3];
+    // RGBA per palette entry; entries the PLTE chunk doesn't have are opaque black.
+    std::array<uint8_t, 1024> m_palette;
+    std::vector<uint8_t> m_samples;
+
+public:
+    // CREATORS
+    // Throws std::exception for a combination IHDR doesn't allow.
+    PngPixelFormat(uint8_t color_type, uint8_t bit_depth);
+
+    // MANIPULATORS
+    // Takes the payloads of the PLTE and tRNS chunks; throws std::exception when they are malformed.
+    void set_palette(const uint8_t* data, size_t size);
+    void set_transparency(const uint8_t* data, size_t size);
+    // Expands `width` pixels of an unfiltered scanline.
+    void expand_rgb(const uint8_t* row, size_t width, uint8_t* rgb);
+    void expand_rgba(const uint8_t* row, size_t width, uint8_t* rgba);
+
+    // ACCESSORS
+    [[nodiscard]] static bool valid(uint8_t color_type, uint8_t bit_depth);
+    [[nodiscard]] uint8_t color_type() const { return m_color_type; }
+    [[nodiscard]] uint8_t bit_depth() const { return m_bit_depth; }
+    [[nodiscard]] bool has_palette() const { return m_has_palette; }
+    [[nodiscard]] int32_t channels() const;
+    // The distance filters look back, at least one byte.
+    [[nodiscard]] size_t bytes_per_pixel() const;
+    [[nodiscard]] size_t row_bytes(size_t width) const;
+    // An alpha channel or a tRNS chunk.
+    [[nodiscard]] bool has_alpha() const;
+private:
+    template <int32_t OutChannels>
+    void expand(const uint8_t* row, size_t width, uint8_t* out);
+    void apply_transparent_key(const uint8_t* row, size_t width, uint8_t* rgba) const;
+};
+
+// Drops the alpha byte of `count` RGBA pixels.
+void rgba_to_rgb(const uint8_t* rgba, size_t count, uint8_t* rgb);
+
+#endif //PNG_FORMAT_H
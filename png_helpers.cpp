@@ -1,196 +1,77 @@
 #include "png_helpers.h"
 
+#include "parallel.h"
+
 #include <cassert>
+#include <cstdlib>
+#include <utility>
 
-size_t index_(const int32_t row, const int32_t col, const int32_t width)
-{
-    return (row * width + col) * 3 + (row + 1);
-}
+static std::vector<std::vector<int8_t> > make_interlace_kernel(int32_t size);
 
-std::vector<uint8_t> filter(const Image3x8& image, const uint8_t fitler_type)
+void filter_rows(const Image3x8& image, const int32_t begin, const int32_t end, const int32_t filter_type,
+    const bool restart, uint8_t* out)
 {
-    assert(fitler_type <= 5 && "out of range filter_type");
-    const int64_t length_scanline = image.width() * 3 + 1;
-    std::vector<uint8_t> result((image.height() * image.width()) * 3 + image.height());
-    for (int32_t row = 0; row < image.height(); ++row) {
-        result[length_scanline * row] = fitler_type;
-        switch (fitler_type) {
-        case 0:
-            for (int32_t col = 0; col < image.width(); ++col) {
-                const size_t index = index_(row, col, image.width());
-                const Pixel x = image[row][col];
-                result[index + 0] = x.red;
-                result[index + 1] = x.green;
-                result[index + 2] = x.blue;
-            }
-            break;
-        case 1:
-            for (int32_t col = 0; col < image.width(); ++col) {
-                const size_t index = index_(row, col, image.width());
-                const Pixel x = image[row][col];
-                Pixel a;
-                if (col != 0)
-                    a = image[row][col - 1];
-                result[index + 0] = filter_one_two(x.red, a.red);
-                result[index + 1] = filter_one_two(x.green, a.green);
-                result[index + 2] = filter_one_two(x.blue, a.blue);
-            }
-            break;
-        case 2:
-            for (int32_t col = 0; col < image.width(); ++col) {
-                const size_t index = index_(row, col, image.width());
-                const Pixel x = image[row][col];
-                Pixel b;
-                if (row != 0)
-                    b = image[row - 1][col];
-                result[index + 0] = filter_one_two(x.red, b.red);
-                result[index + 1] = filter_one_two(x.green, b.green);
-                result[index + 2] = filter_one_two(x.blue, b.blue);
-            }
-            break;
-        case 3:
-            for (int32_t col = 0; col < image.width(); ++col) {
-                const size_t index = index_(row, col, image.width());
-                Pixel a, b;
-                const Pixel x = image[row][col];
-                if (col != 0)
-                    a = image[row][col - 1];
-                if (row != 0)
-                    b = image[row - 1][col];
-                result[index + 0] = filter_three(x.red, a.red, b.red);
-                result[index + 1] = filter_three(x.green, a.green, b.green);
-                result[index + 2] = filter_three(x.blue, a.blue, b.blue);
-            }
-            break;
-        case 4:
-            for (int32_t col = 0; col < image.width(); ++col) {
-                const size_t index = index_(row, col, image.width());
-                Pixel a, b, c;
-                const Pixel x = image[row][col];
-                if (row != 0)
-                    b = image[row - 1][col];
-                if (col != 0)
-                    a = image[row][col - 1];
-                if (row != 0 && col != 0)
-                    c = image[row - 1][col - 1];
-                result[index + 0] = (x.red - peath(a.red, b.red, c.red)) % 256;
-                result[index + 1] = (x.green - peath(a.green, b.green, c.green)) % 256;
-                result[index + 2] = (x.blue - peath(a.blue, b.blue, c.blue)) % 256;
-            }
-            break;
-        default:
-            throw std::exception();
-        }
+    assert(-1 <= filter_type && filter_type <= 4 && "out of range filter_type");
+    const size_t length = static_cast<size_t>(image.width()) * 3;
+    const std::vector<uint8_t> zeros(length);
+    for (int32_t row = begin; row < end; ++row, out += length + 1) {
+        const auto* current = reinterpret_cast<const uint8_t*>(image[row]);
+        const uint8_t* previous = row == 0 ? zeros.data() : reinterpret_cast<const uint8_t*>(image[row - 1]);
+        if (restart && row == begin && (filter_type < 0 || 1 < filter_type))
+            out[0] = choose_filter(current, previous, length, 3, 2);
+        else if (filter_type < 0)
+            out[0] = choose_filter(current, previous, length, 3);
+        else
+            out[0] = static_cast<uint8_t>(filter_type);
+        filter_row(out[0], current, previous, length, 3, out + 1);
     }
-    return result;
-}
-
-uint8_t filter_one_two(const uint8_t x, const uint8_t ab)
-{
-    return (x - ab) % 256;
 }
 
-static uint8_t filter_three(const uint8_t x, const uint8_t a, const uint8_t b)
+std::vector<uint8_t> filter(const Image3x8& image, const uint8_t filter_type)
 {
-    return (x - (a + b) / 2) % 256;
+    assert(filter_type <= 4 && "out of range filter_type");
+    std::vector<uint8_t> result(image.size() * 3 + image.height());
+    parallel_bands(image.height(), [&](const int32_t begin, const int32_t end) {
+        filter_rows(image, begin, end, filter_type, false, result.data() + begin * (image.width() * size_t(3) + 1));
+    });
+    return result;
 }
 
-static uint8_t peath(const uint8_t a, const uint8_t b, const uint8_t c)
+std::vector<uint8_t> filter_adaptive(const Image3x8& image)
 {
-    const int32_t p = a + b + c;
-    int32_t pa = std::abs(p - a);
-    int32_t pb = std::abs(p - b);
-    int32_t pc = std::abs(p - c);
-    if (pa <= pb && pa <= pc)
-        return a;
-    if (pb <= pc)
-        return b;
-    return c;
+    std::vector<uint8_t> result(image.size() * 3 + image.height());
+    parallel_bands(image.height(), [&](const int32_t begin, const int32_t end) {
+        filter_rows(image, begin, end, -1, false, result.data() + begin * (image.width() * size_t(3) + 1));
+    });
+    return result;
 }
 
 Image3x8 defilter(const std::vector<uint8_t>& data, const int32_t height, const int32_t width)
 {
+    const size_t length = static_cast<size_t>(width) * 3;
     Image3x8 result(height, width);
-    result[0][0].red = data[1 + 0];
-    result[0][0].green = data[1 + 1];
-    result[0][0].blue = data[1 + 2];
-    for (int32_t row = 0; row < height; ++row) {
-        const uint32_t filter_type = data[row * width * 3 + row];
-        assert(filter_type <= 5 && "out of range filter_type");
-        switch (filter_type) {
-        case 0:
-            for (int32_t col = 0; col < width; ++col) {
-                const size_t index_x = index_(row, col, width);
-                result[row][col].red = data[index_x + 0];
-                result[row][col].green = data[index_x + 1];
-                result[row][col].blue = data[index_x + 2];
-            }
-            break;
-        case 1:
-            for (int32_t col = 0; col < width; ++col) {
-                const size_t index_x = index_(row, col, width);
-                Pixel a;
-                if (col != 0)
-                    a = result[row][col - 1];
-                result[row][col].red = defilter_one_two(data[index_x + 0], a.red);
-                result[row][col].green = defilter_one_two(data[index_x + 1], a.green);
-                result[row][col].blue = defilter_one_two(data[index_x + 2], a.blue);
-            }
-            break;
-        case 2:
-            for (int32_t col = 0; col < width; ++col) {
-                const size_t index_x = index_(row, col, width);
-                Pixel b;
-                if (row != 0)
-                    b = result[row - 1][col];
-                result[row][col].red = defilter_one_two(data[index_x + 0], b.red);
-                result[row][col].green = defilter_one_two(data[index_x + 1], b.green);
-                result[row][col].blue = defilter_one_two(data[index_x + 2], b.blue);
-            }
-            break;
-        case 3:
-            for (int32_t col = 0; col < width; ++col) {
-                const size_t index_x = index_(row, col, width);
-                Pixel a, b;
-                if (col != 0)
-                    a = result[row][col - 1];
-                if (row != 0)
-                    b = result[row - 1][col];
-                result[row][col].red = defilter_three(data[index_x + 0], a.red, b.red);
-                result[row][col].green = defilter_three(data[index_x + 1], a.green, b.green);
-                result[row][col].blue = defilter_three(data[index_x + 2], a.blue, b.blue);
-            }
-            break;
-        case 4:
-            for (int32_t col = 0; col < width; ++col) {
-                const size_t index_x = index_(row, col, width);
-                Pixel a, b, c;
-                if (col != 0)
-                    a = result[row][col - 1];
-                if (row != 0)
-                    b = result[row - 1][col];
-                if (row != 0 && col != 0)
-                    c = result[row - 1][col - 1];
-                result[row][col].red = (data[index_x + 0] + peath(a.red, b.red, c.red)) % 256;
-                result[row][col].green = (data[index_x + 1] + peath(a.green, b.green, c.green)) % 256;
-                result[row][col].blue = (data[index_x + 2] + peath(a.blue, b.blue, c.blue)) % 256;
-            }
-            break;
-        default:
-            throw std::exception();
-        }
-    }
+    ScanlineReader scanlines(height, length, 3);
+    scanlines.push(data.data(), data.size(), [&](int32_t, const int32_t row, const uint8_t* bytes) {
+        std::copy_n(bytes, length, reinterpret_cast<uint8_t*>(result[row]));
+    });
     return result;
 }
 
-static uint8_t defilter_one_two(const uint8_t x, const uint8_t ab)
+ScanlineReader::ScanlineReader(std::vector<ScanlinePass> passes, const size_t bytes_per_pixel)
+    : m_passes(std::move(passes)), m_pass(0), m_row(0), m_bytes_per_pixel(bytes_per_pixel), m_filled(0)
 {
-    return (x + ab) % 256;
+    start_pass();
 }
 
-static uint8_t defilter_three(const uint8_t x, const uint8_t a, const uint8_t b)
+void ScanlineReader::start_pass()
 {
-    return (x + (a + b) / 2) % 256;
+    while (m_pass < m_passes.size() && (m_passes[m_pass].rows == 0 || m_passes[m_pass].length == 0))
+        ++m_pass;
+    m_row = 0;
+    if (done())
+        return;
+    m_current.assign(m_passes[m_pass].length + 1, 0);
+    m_previous.assign(m_passes[m_pass].length + 1, 0);
 }
 
 static Pixel get_pixel(const std::vector<Image3x8>& images,
@@ -4,17 +4,109 @@
 #define PNG_HELPERS_H
 
 #include "Image3x8.h"
+#include "unfilter.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
 
 Image3x8 interlace(const std::vector<Image3x8>& images, int32_t height, int32_t width);
-static std::vector<std::vector<int8_t> > make_interlace_kernel(int32_t size);
-std::vector<uint8_t> filter(const Image3x8& image, uint8_t fitler_type);
-static size_t index_(int32_t row, int32_t col, int32_t width);
-static uint8_t filter_one_two(uint8_t x, uint8_t ab);
-static uint8_t filter_three(uint8_t x, uint8_t a, uint8_t b);
-static uint8_t peath(uint8_t a, uint8_t b, uint8_t c);
+// Scanlines with their filter type bytes: every one filtered with `filter_type`, or with the type choose_filter
+// picks for it.
+std::vector<uint8_t> filter(const Image3x8& image, uint8_t filter_type);
+std::vector<uint8_t> filter_adaptive(const Image3x8& image);
+// Rows [begin, end) of the above into `out`, with `filter_type` or, for -1, the type choose_filter picks. With
+// `restart` the first row only uses None or Sub, so it can be unfiltered without the row above it.
+void filter_rows(const Image3x8& image, int32_t begin, int32_t end, int32_t filter_type, bool restart, uint8_t* out);
 Image3x8 defilter(const std::vector<uint8_t>& data, int32_t height, int32_t width);
-static uint8_t defilter_one_two(uint8_t x, uint8_t ab);
-static uint8_t defilter_three(uint8_t x, uint8_t a, uint8_t b);
 
+// An entry of the private rsTR chunk that write_png_file puts in front of the image data: the zlib stream can be
+// inflated from `offset` on without what comes before it, and the scanline at `row`, the first of its band, only
+// uses the None or Sub filter. The chunk is a list of them, both fields big-endian, starting with row 0 at offset 2
+// (past the zlib header) and rising.
+struct RestartMarker {
+    uint32_t row;
+    uint32_t offset;
+};
+
+// One of the seven Adam7 passes: the pixels at rows first_row + k * row_step and columns first_col + k * col_step.
+struct Adam7Pass {
+    int32_t first_row;
+    int32_t first_col;
+    int32_t row_step;
+    int32_t col_step;
+};
+
+inline constexpr Adam7Pass s_adam7_passes[7] = {
+    { 0, 0, 8, 8 }, { 0, 4, 8, 8 }, { 4, 0, 8, 4 }, { 0, 2, 4, 4 }, { 2, 0, 4, 2 }, { 0, 1, 2, 2 }, { 1, 0, 2, 1 }
+};
+
+// Rows (or columns) a pass starting at `first` with `step` takes from `size`.
+inline int32_t adam7_count(const int32_t size, const int32_t first, const int32_t step)
+{
+    return size <= first ? 0 : (size - first + step - 1) / step;
+}
+
+// `rows` scanlines of `length` bytes, not counting their filter bytes.
+struct ScanlinePass {
+    int32_t rows;
+    size_t length;
+};
+
+// Cuts decompressed image data, which may arrive in pieces of any size, into scanlines and unfilters each one as
+// soon as it is complete. Only the current and the previous scanline are kept. Interlaced data is a sequence of
+// passes that are each filtered on their own; empty passes have no scanlines at all.
+class ScanlineReader {
+    std::vector<ScanlinePass> m_passes;
+    size_t m_pass;
+    int32_t m_row;
+    size_t m_bytes_per_pixel;
+    size_t m_filled;
+    std::vector<uint8_t> m_previous;
+    std::vector<uint8_t> m_current;
+
+public:
+    // CREATORS
+    ScanlineReader(std::vector<ScanlinePass> passes, size_t bytes_per_pixel);
+    ScanlineReader(const int32_t height, const size_t row_length, const size_t bytes_per_pixel)
+        : ScanlineReader({ { height, row_length } }, bytes_per_pixel)
+    {
+    }
+
+    // MANIPULATORS
+    // Calls function(pass, row, bytes) with every scanline `data` completes.
+    template <typename Function>
+    void push(const uint8_t* data, size_t size, Function&& function);
+
+    // ACCESSORS
+    [[nodiscard]] bool done() const { return m_pass == m_passes.size(); }
+private:
+    void start_pass();
+};
+
+template <typename Function>
+void ScanlineReader::push(const uint8_t* data, size_t size, Function&& function)
+{
+    while (size != 0) {
+        if (done())
+            throw std::exception();
+        const size_t count = std::min(size, m_current.size() - m_filled);
+        std::copy_n(data, count, m_current.data() + m_filled);
+        m_filled += count;
+        data += count;
+        size -= count;
+        if (m_filled < m_current.size())
+            continue;
+        unfilter_row(m_current[0], m_current.data() + 1, m_previous.data() + 1, m_current.size() - 1,
+            m_bytes_per_pixel);
+        function(static_cast<int32_t>(m_pass), m_row, m_current.data() + 1);
+        m_previous.swap(m_current);
+        m_filled = 0;
+        if (++m_row == m_passes[m_pass].rows) {
+            ++m_pass;
+            start_pass();
+        }
+    }
+}
 
 #endif //PNG_HELPERS_H
@@ -0,0 +1,260 @@
+#include "resample.h"
+
+#include "cpu_dispatch.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <exception>
+#include <numbers>
+
+static double filter_support(const ResizeFilter filter)
+{
+    switch (filter) {
+    case ResizeFilter::Box:
+        return 0.5;
+    case ResizeFilter::Bilinear:
+        return 1.0;
+    case ResizeFilter::Bicubic:
+        return 2.0;
+    case ResizeFilter::Lanczos:
+        return 3.0;
+    }
+    return 1.0;
+}
+
+static double sinc(const double x)
+{
+    if (x == 0.0)
+        return 1.0;
+    return std::sin(std::numbers::pi * x) / (std::numbers::pi * x);
+}
+
+static double filter_value(const ResizeFilter filter, double x)
+{
+    x = std::abs(x);
+    switch (filter) {
+    case ResizeFilter::Box:
+        return x <= 0.5 ? 1.0 : 0.0;
+    case ResizeFilter::Bilinear:
+        return x < 1.0 ? 1.0 - x : 0.0;
+    case ResizeFilter::Bicubic: {
+        constexpr double a = -0.5;
+        if (x < 1.0)
+            return ((a + 2.0) * x - (a + 3.0)) * x * x + 1.0;
+        if (x < 2.0)
+            return (((x - 5.0) * x + 8.0) * x - 4.0) * a;
+        return 0.0;
+    }
+    case ResizeFilter::Lanczos:
+        return x < 3.0 ? sinc(x) * sinc(x / 3.0) : 0.0;
+    }
+    return 0.0;
+}
+
+static int32_t filter_taps(const int32_t src_size, const int32_t dst_size, const ResizeFilter filter)
+{
+    const double filter_scale = std::max(static_cast<double>(src_size) / dst_size, 1.0);
+    return std::min(static_cast<int32_t>(std::ceil(filter_support(filter) * filter_scale)) * 2 + 1, src_size);
+}
+
+// Calls store(i, start, weights) for every output sample with its `taps` weights normalized to sum to one.
+template <typename Store>
+static void for_each_weight_row(const int32_t src_size, const int32_t dst_size, const ResizeFilter filter,
+    const int32_t taps, Store&& store)
+{
+    const double scale = static_cast<double>(src_size) / dst_size;
+    const double filter_scale = std::max(scale, 1.0);
+    const double support = filter_support(filter) * filter_scale;
+    std::vector<double> weights(taps);
+    for (int32_t i = 0; i < dst_size; ++i) {
+        const double center = (i + 0.5) * scale;
+        const int32_t first = std::max(static_cast<int32_t>(std::floor(center - support)), 0);
+        const int32_t last = std::min(static_cast<int32_t>(std::ceil(center + support)), src_size);
+        const int32_t start = std::min(first, src_size - taps);
+        std::fill(weights.begin(), weights.end(), 0.0);
+        double sum = 0;
+        for (int32_t x = first; x < last; ++x) {
+            double weight;
+            if (filter == ResizeFilter::Box)
+                weight = std::max(0.0, std::min(x + 1.0, center + support) - std::max(static_cast<double>(x),
+                    center - support));
+            else
+                weight = filter_value(filter, (x + 0.5 - center) / filter_scale);
+            weights[x - start] = weight;
+            sum += weight;
+        }
+        if (sum == 0.0) {
+            weights[std::clamp(static_cast<int32_t>(center) - start, 0, taps - 1)] = 1.0;
+            sum = 1.0;
+        }
+        for (double& weight : weights)
+            weight /= sum;
+        store(i, start, weights);
+    }
+}
+
+ResampleWeights make_resample_weights(const int32_t src_size, const int32_t dst_size, const ResizeFilter filter)
+{
+    ResampleWeights result;
+    result.taps = filter_taps(src_size, dst_size, filter);
+    result.start.resize(dst_size);
+    result.weights.assign(static_cast<size_t>(dst_size) * result.taps, 0);
+    for_each_weight_row(src_size, dst_size, filter, result.taps,
+        [&](const int32_t i, const int32_t start, const std::vector<double>& weights) {
+            constexpr int32_t one = 1 << ResampleWeights::s_precision_bits;
+            int16_t* fixed = &result.weights[static_cast<size_t>(i) * result.taps];
+            int32_t total = 0;
+            int32_t largest = 0;
+            for (int32_t k = 0; k < result.taps; ++k) {
+                fixed[k] = static_cast<int16_t>(std::lround(weights[k] * one));
+                total += fixed[k];
+                if (std::abs(fixed[largest]) < std::abs(fixed[k]))
+                    largest = k;
+            }
+            fixed[largest] = static_cast<int16_t>(fixed[largest] + one - total);
+            result.start[i] = start;
+        });
+    return result;
+}
+
+ResampleWeightsFloat make_resample_weights_float(const int32_t src_size, const int32_t dst_size,
+    const ResizeFilter filter)
+{
+    ResampleWeightsFloat result;
+    result.taps = filter_taps(src_size, dst_size, filter);
+    result.start.resize(dst_size);
+    result.weights.resize(static_cast<size_t>(dst_size) * result.taps);
+    for_each_weight_row(src_size, dst_size, filter, result.taps,
+        [&](const int32_t i, const int32_t start, const std::vector<double>& weights) {
+            std::copy(weights.begin(), weights.end(), &result.weights[static_cast<size_t>(i) * result.taps]);
+            result.start[i] = start;
+        });
+    return result;
+}
+
+static uint8_t clamp_fixed(const int32_t value)
+{
+    return static_cast<uint8_t>(std::clamp(value >> ResampleWeights::s_precision_bits, 0, 255));
+}
+
+template <int32_t Channels>
+SIMD_INLINE void horizontal_rows(const uint8_t* src, const int32_t begin, const int32_t end, const int32_t src_width,
+    uint8_t* dst, const int32_t dst_width, const ResampleWeights& weights)
+{
+    constexpr int32_t rounding = 1 << (ResampleWeights::s_precision_bits - 1);
+    const int32_t taps = weights.taps;
+    for (int32_t row = begin; row < end; ++row) {
+        const uint8_t* src_row = src + static_cast<size_t>(row) * src_width * Channels;
+        uint8_t* dst_row = dst + static_cast<size_t>(row) * dst_width * Channels;
+        for (int32_t col = 0; col < dst_width; ++col) {
+            const uint8_t* pixels = src_row + weights.start[col] * Channels;
+            const int16_t* weight = &weights.weights[static_cast<size_t>(col) * taps];
+            int32_t sum[Channels];
+            for (int32_t channel = 0; channel < Channels; ++channel)
+                sum[channel] = rounding;
+            for (int32_t k = 0; k < taps; ++k)
+                for (int32_t channel = 0; channel < Channels; ++channel)
+                    sum[channel] += weight[k] * pixels[k * Channels + channel];
+            for (int32_t channel = 0; channel < Channels; ++channel)
+                dst_row[col * Channels + channel] = clamp_fixed(sum[channel]);
+        }
+    }
+}
+
+SIMD_DISPATCH(void, horizontal_rows_1, horizontal_rows<1>, (const uint8_t* src, const int32_t begin,
+    const int32_t end, const int32_t src_width, uint8_t* dst, const int32_t dst_width,
+    const ResampleWeights& weights), (src, begin, end, src_width, dst, dst_width, weights))
+SIMD_DISPATCH(void, horizontal_rows_3, horizontal_rows<3>, (const uint8_t* src, const int32_t begin,
+    const int32_t end, const int32_t src_width, uint8_t* dst, const int32_t dst_width,
+    const ResampleWeights& weights), (src, begin, end, src_width, dst, dst_width, weights))
+SIMD_DISPATCH(void, horizontal_rows_4, horizontal_rows<4>, (const uint8_t* src, const int32_t begin,
+    const int32_t end, const int32_t src_width, uint8_t* dst, const int32_t dst_width,
+    const ResampleWeights& weights), (src, begin, end, src_width, dst, dst_width, weights))
+
+void resample_horizontal(const uint8_t* src, const int32_t height, const int32_t src_width, uint8_t* dst,
+    const int32_t dst_width, const int32_t channels, const ResampleWeights& weights)
+{
+    if (channels != 1 && channels != 3 && channels != 4)
+        throw std::exception();
+    parallel_bands(height, [&](const int32_t begin, const int32_t end) {
+        if (channels == 1)
+            horizontal_rows_1(src, begin, end, src_width, dst, dst_width, weights);
+        else if (channels == 3)
+            horizontal_rows_3(src, begin, end, src_width, dst, dst_width, weights);
+        else
+            horizontal_rows_4(src, begin, end, src_width, dst, dst_width, weights);
+    });
+}
+
+SIMD_INLINE void vertical_rows_body(const uint8_t* src, const size_t stride, uint8_t* dst, const int32_t begin,
+    const int32_t end, const ResampleWeights& weights)
+{
+    constexpr int32_t rounding = 1 << (ResampleWeights::s_precision_bits - 1);
+    std::vector<int32_t> sum(stride);
+    for (int32_t row = begin; row < end; ++row) {
+        std::fill(sum.begin(), sum.end(), rounding);
+        const int16_t* weight = &weights.weights[static_cast<size_t>(row) * weights.taps];
+        for (int32_t k = 0; k < weights.taps; ++k) {
+            if (weight[k] == 0)
+                continue;
+            const int32_t factor = weight[k];
+            const uint8_t* src_row = src + (weights.start[row] + k) * stride;
+            for (size_t i = 0; i < stride; ++i)
+                sum[i] += factor * src_row[i];
+        }
+        uint8_t* dst_row = dst + row * stride;
+        for (size_t i = 0; i < stride; ++i)
+            dst_row[i] = clamp_fixed(sum[i]);
+    }
+}
+
+SIMD_DISPATCH(void, vertical_rows, vertical_rows_body, (const uint8_t* src, const size_t stride, uint8_t* dst,
+    const int32_t begin, const int32_t end, const ResampleWeights& weights),
+    (src, stride, dst, begin, end, weights))
+
+void resample_vertical(const uint8_t* src, const int32_t width, uint8_t* dst, const int32_t dst_height,
+    const int32_t channels, const ResampleWeights& weights)
+{
+    const size_t stride = static_cast<size_t>(width) * channels;
+    parallel_bands(dst_height, [&](const int32_t begin, const int32_t end) {
+        vertical_rows(src, stride, dst, begin, end, weights);
+    }, 4);
+}
+
+void resample(const uint8_t* src, const int32_t src_height, const int32_t src_width, uint8_t* dst,
+    const int32_t dst_height, const int32_t dst_width, const int32_t channels, const ResizeFilter filter)
+{
+    const bool scale_rows = src_height != dst_height;
+    const bool scale_cols = src_width != dst_width;
+    if (!scale_rows && !scale_cols) {
+        std::memcpy(dst, src, static_cast<size_t>(src_height) * src_width * channels);
+        return;
+    }
+    if (!scale_rows) {
+        resample_horizontal(src, src_height, src_width, dst, dst_width, channels,
+            make_resample_weights(src_width, dst_width, filter));
+        return;
+    }
+    if (!scale_cols) {
+        resample_vertical(src, src_width, dst, dst_height, channels,
+            make_resample_weights(src_height, dst_height, filter));
+        return;
+    }
+    const ResampleWeights weights_x = make_resample_weights(src_width, dst_width, filter);
+    const ResampleWeights weights_y = make_resample_weights(src_height, dst_height, filter);
+    const int64_t cost_cols_first = static_cast<int64_t>(src_height) * dst_width * weights_x.taps
+        + static_cast<int64_t>(dst_height) * dst_width * weights_y.taps;
+    const int64_t cost_rows_first = static_cast<int64_t>(dst_height) * src_width * weights_y.taps
+        + static_cast<int64_t>(dst_height) * dst_width * weights_x.taps;
+    if (cost_cols_first <= cost_rows_first) {
+        std::vector<uint8_t> temp(static_cast<size_t>(src_height) * dst_width * channels);
+        resample_horizontal(src, src_height, src_width, temp.data(), dst_width, channels, weights_x);
+        resample_vertical(temp.data(), dst_width, dst, dst_height, channels, weights_y);
+    } else {
+        std::vector<uint8_t> temp(static_cast<size_t>(dst_height) * src_width * channels);
+        resample_vertical(src, src_width, temp.data(), dst_height, channels, weights_y);
+        resample_horizontal(temp.data(), dst_height, src_width, dst, dst_width, channels, weights_x);
+    }
+}
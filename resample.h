@@ -0,0 +1,40 @@
+#pragma once
+
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+
+#include <cstdint>
+#include <vector>
+
+enum class ResizeFilter : uint8_t {
+    Box,
+    Bilinear,
+    Bicubic,
+    Lanczos
+};
+
+// Per-axis weight table in 2.14 fixed point; every output sample owns `taps` weights starting at `start`.
+struct ResampleWeights {
+    static constexpr int32_t s_precision_bits = 14;
+    int32_t taps;
+    std::vector<int32_t> start;
+    std::vector<int16_t> weights;
+};
+
+// The same weights unquantized, for resampling float samples.
+struct ResampleWeightsFloat {
+    int32_t taps;
+    std::vector<int32_t> start;
+    std::vector<float> weights;
+};
+
+ResampleWeights make_resample_weights(int32_t src_size, int32_t dst_size, ResizeFilter filter);
+ResampleWeightsFloat make_resample_weights_float(int32_t src_size, int32_t dst_size, ResizeFilter filter);
+void resample_horizontal(const uint8_t* src, int32_t height, int32_t src_width, uint8_t* dst, int32_t dst_width,
+    int32_t channels, const ResampleWeights& weights);
+void resample_vertical(const uint8_t* src, int32_t width, uint8_t* dst, int32_t dst_height, int32_t channels,
+    const ResampleWeights& weights);
+void resample(const uint8_t* src, int32_t src_height, int32_t src_width, uint8_t* dst, int32_t dst_height,
+    int32_t dst_width, int32_t channels, ResizeFilter filter);
+
+#endif //RESAMPLE_H
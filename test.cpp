@@ -1,5 +1,12 @@
 #include "test.h"
 #include "Image3x8.h"
+#include "inflate.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iterator>
 
 void test_interlacing()
 {
@@ -7,4 +14,31 @@ void test_interlacing()
 	// const std::vector<Image3x8> interlacing = copy.interlace();
 	// Image3x8 interlaced = interlace(interlacing, copy.height(), copy.width());
 	// interlaced.write("copy.bmp");
-}
\ No newline at end of file
+}
+
+void bench_inflate(const std::vector<const char*>& paths, const int repeats)
+{
+	double total_bytes = 0;
+	double total_seconds = 0;
+	for (const char* path : paths) {
+		std::ifstream ifs(path, std::ios::in | std::ios::binary);
+		if (!ifs.is_open()) {
+			std::cout << "File could not be opened " << path << '\n';
+			continue;
+		}
+		const std::vector<uint8_t> compressed((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+		size_t size = 0;
+		double best = 1e30;
+		for (int i = 0; i < repeats; ++i) {
+			const auto start = std::chrono::steady_clock::now();
+			size = zlib_decompress(compressed.data(), compressed.size(), size).size();
+			const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+			best = std::min(best, elapsed.count());
+		}
+		std::cout << path << ' ' << compressed.size() << " -> " << size << " bytes, " << size / best / 1e6 << " MB/s\n";
+		total_bytes += static_cast<double>(size);
+		total_seconds += best;
+	}
+	if (0 < total_seconds)
+		std::cout << "total " << total_bytes / total_seconds / 1e6 << " MB/s\n";
+}
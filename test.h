@@ -3,6 +3,10 @@
 #ifndef TEST_H
 #define TEST_H
 
+#include <vector>
+
 void test_interlacing();
+// Decompresses each zlib file `repeats` times and prints the output throughput in MB/s.
+void bench_inflate(const std::vector<const char*>& paths, int repeats);
 
 #endif //TEST_H
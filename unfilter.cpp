@@ -0,0 +1,392 @@
+#include "unfilter.h"
+
+#include "cpu_dispatch.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define UNFILTER_SSE
+#endif
+
+uint8_t paeth_predictor(const uint8_t a, const uint8_t b, const uint8_t c)
+{
+    const int32_t pa = std::abs(b - c);
+    const int32_t pb = std::abs(a - c);
+    const int32_t pc = std::abs(a + b - 2 * c);
+    return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+}
+
+SIMD_INLINE void unfilter_up_body(uint8_t* row, const uint8_t* previous, const size_t length)
+{
+    for (size_t i = 0; i < length; ++i)
+        row[i] += previous[i];
+}
+
+SIMD_DISPATCH(void, unfilter_up, unfilter_up_body, (uint8_t* row, const uint8_t* previous, const size_t length),
+    (row, previous, length))
+
+SIMD_INLINE void unfilter_scalar_body(const uint8_t filter_type, uint8_t* row, const uint8_t* previous,
+    const size_t length, const size_t bpp)
+{
+    const size_t first = std::min(bpp, length);
+    switch (filter_type) {
+    case 1:
+        for (size_t i = first; i < length; ++i)
+            row[i] += row[i - bpp];
+        break;
+    case 3:
+        for (size_t i = 0; i < first; ++i)
+            row[i] += previous[i] >> 1;
+        for (size_t i = first; i < length; ++i)
+            row[i] += (row[i - bpp] + previous[i]) >> 1;
+        break;
+    case 4:
+        for (size_t i = 0; i < first; ++i)
+            row[i] += previous[i];
+        for (size_t i = first; i < length; ++i)
+            row[i] += paeth_predictor(row[i - bpp], previous[i], previous[i - bpp]);
+        break;
+    default:
+        break;
+    }
+}
+
+// One instance per pixel size PNG has (1, 2, 3, 4, 6 and 8 bytes), so the distance to the left pixel is a constant.
+template <size_t Bpp>
+static void unfilter_scalar(const uint8_t filter_type, uint8_t* row, const uint8_t* previous, const size_t length)
+{
+    unfilter_scalar_body(filter_type, row, previous, length, Bpp);
+}
+
+#ifdef UNFILTER_SSE
+// Sub, Average and Paeth depend on the pixel to the left, so the SSE kernels work on whole pixels: Sub adds the
+// pixels of a register at once with log-step shifts (a prefix sum) plus the last pixel of the group before, the
+// other two handle one pixel per step with all its channels in one register. Average of 1 and 2 byte pixels is
+// quicker in the scalar loop.
+
+// Paeth predictions for 8 bytes widened to 16 bits.
+SIMD_TARGET_SSE41 static __m128i paeth_predict_sse(const __m128i a, const __m128i b, const __m128i c)
+{
+    const __m128i up = _mm_sub_epi16(b, c);
+    const __m128i left = _mm_sub_epi16(a, c);
+    const __m128i pa = _mm_abs_epi16(up);
+    const __m128i pb = _mm_abs_epi16(left);
+    const __m128i pc = _mm_abs_epi16(_mm_add_epi16(up, left));
+    const __m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+    const __m128i predictor = _mm_blendv_epi8(c, b, _mm_cmpeq_epi16(pb, smallest));
+    return _mm_blendv_epi8(predictor, a, _mm_cmpeq_epi16(pa, smallest));
+}
+
+template <size_t Bpp>
+SIMD_TARGET_SSE41 static __m128i load_pixel(const uint8_t* pixel)
+{
+    if constexpr (Bpp == 8) {
+        return _mm_loadl_epi64(reinterpret_cast<const __m128i*>(pixel));
+    } else if constexpr (Bpp == 6) {
+        uint32_t low;
+        uint16_t high;
+        std::memcpy(&low, pixel, 4);
+        std::memcpy(&high, pixel + 4, 2);
+        return _mm_insert_epi16(_mm_cvtsi32_si128(static_cast<int32_t>(low)), high, 2);
+    } else if constexpr (Bpp == 4) {
+        uint32_t value;
+        std::memcpy(&value, pixel, 4);
+        return _mm_cvtsi32_si128(static_cast<int32_t>(value));
+    } else if constexpr (Bpp == 3) {
+        uint16_t low;
+        std::memcpy(&low, pixel, 2);
+        return _mm_cvtsi32_si128(static_cast<int32_t>(low | static_cast<uint32_t>(pixel[2]) << 16));
+    } else if constexpr (Bpp == 2) {
+        uint16_t value;
+        std::memcpy(&value, pixel, 2);
+        return _mm_cvtsi32_si128(value);
+    } else {
+        return _mm_cvtsi32_si128(pixel[0]);
+    }
+}
+
+template <size_t Bpp>
+SIMD_TARGET_SSE41 static void store_pixel(uint8_t* pixel, const __m128i value)
+{
+    if constexpr (Bpp == 8) {
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(pixel), value);
+        return;
+    }
+    const auto bytes = static_cast<uint32_t>(_mm_cvtsi128_si32(value));
+    if constexpr (Bpp == 6) {
+        const auto high = static_cast<uint16_t>(_mm_extract_epi16(value, 2));
+        std::memcpy(pixel, &bytes, 4);
+        std::memcpy(pixel + 4, &high, 2);
+    } else if constexpr (Bpp == 4) {
+        std::memcpy(pixel, &bytes, 4);
+    } else if constexpr (Bpp == 3) {
+        const auto low = static_cast<uint16_t>(bytes);
+        std::memcpy(pixel, &low, 2);
+        pixel[2] = static_cast<uint8_t>(bytes >> 16);
+    } else if constexpr (Bpp == 2) {
+        const auto low = static_cast<uint16_t>(bytes);
+        std::memcpy(pixel, &low, 2);
+    } else {
+        pixel[0] = static_cast<uint8_t>(bytes);
+    }
+}
+
+template <size_t Bpp>
+SIMD_TARGET_SSE41 static void unfilter_sub_sse(uint8_t* row, const size_t length)
+{
+    constexpr size_t pixels = Bpp == 3 ? 4 : 16 / Bpp;
+    constexpr size_t group = pixels * Bpp;
+    alignas(16) int8_t last_pixel_bytes[16];
+    for (size_t k = 0; k < 16; ++k)
+        last_pixel_bytes[k] = static_cast<int8_t>((pixels - 1) * Bpp + k % Bpp);
+    const __m128i last_pixel = _mm_load_si128(reinterpret_cast<const __m128i*>(last_pixel_bytes));
+    __m128i carry = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= length; i += group) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+        x = _mm_add_epi8(x, _mm_slli_si128(x, Bpp));
+        if constexpr (2 * Bpp < group)
+            x = _mm_add_epi8(x, _mm_slli_si128(x, 2 * Bpp));
+        if constexpr (4 * Bpp < group)
+            x = _mm_add_epi8(x, _mm_slli_si128(x, 4 * Bpp));
+        if constexpr (8 * Bpp < group)
+            x = _mm_add_epi8(x, _mm_slli_si128(x, 8 * Bpp));
+        x = _mm_add_epi8(x, carry);
+        carry = _mm_shuffle_epi8(x, last_pixel);
+        if constexpr (group == 16) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(row + i), x);
+        } else {
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(row + i), x);
+            store_pixel<4>(row + i + 8, _mm_srli_si128(x, 8));
+        }
+    }
+    for (i = std::max(i, Bpp); i < length; ++i)
+        row[i] += row[i - Bpp];
+}
+
+template <size_t Bpp>
+SIMD_TARGET_SSE41 static void unfilter_average_sse(uint8_t* row, const uint8_t* previous, const size_t length)
+{
+    const __m128i low_bit = _mm_set1_epi8(1);
+    __m128i a = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + Bpp <= length; i += Bpp) {
+        const __m128i b = load_pixel<Bpp>(previous + i);
+        // pavgb rounds up; take the carry back off to get floor((a + b) / 2).
+        const __m128i average = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), low_bit));
+        a = _mm_add_epi8(load_pixel<Bpp>(row + i), average);
+        store_pixel<Bpp>(row + i, a);
+    }
+    // A partial pixel left over when length is not a multiple of Bpp.
+    for (; i < length; ++i)
+        row[i] += i < Bpp ? previous[i] >> 1 : (row[i - Bpp] + previous[i]) >> 1;
+}
+
+template <size_t Bpp>
+SIMD_TARGET_SSE41 static void unfilter_paeth_sse(uint8_t* row, const uint8_t* previous, const size_t length)
+{
+    __m128i a = _mm_setzero_si128();
+    __m128i c = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + Bpp <= length; i += Bpp) {
+        const __m128i b = _mm_cvtepu8_epi16(load_pixel<Bpp>(previous + i));
+        const __m128i predictor = paeth_predict_sse(a, b, c);
+        const __m128i pixel = _mm_add_epi8(load_pixel<Bpp>(row + i), _mm_packus_epi16(predictor, predictor));
+        store_pixel<Bpp>(row + i, pixel);
+        a = _mm_cvtepu8_epi16(pixel);
+        c = b;
+    }
+    for (; i < length; ++i)
+        row[i] += i < Bpp ? previous[i] : paeth_predictor(row[i - Bpp], previous[i], previous[i - Bpp]);
+}
+
+template <size_t Bpp>
+SIMD_TARGET_SSE41 static void unfilter_sse(const uint8_t filter_type, uint8_t* row, const uint8_t* previous,
+    const size_t length)
+{
+    if (filter_type == 1)
+        unfilter_sub_sse<Bpp>(row, length);
+    else if (filter_type == 3 && Bpp < 3)
+        unfilter_scalar<Bpp>(filter_type, row, previous, length);
+    else if (filter_type == 3)
+        unfilter_average_sse<Bpp>(row, previous, length);
+    else
+        unfilter_paeth_sse<Bpp>(row, previous, length);
+}
+#endif
+
+void unfilter_row(const uint8_t filter_type, uint8_t* row, const uint8_t* previous, const size_t length,
+    const size_t bytes_per_pixel)
+{
+    if (4 < filter_type)
+        throw std::exception();
+    if (filter_type == 0)
+        return;
+    if (filter_type == 2) {
+        unfilter_up(row, previous, length);
+        return;
+    }
+#ifdef UNFILTER_SSE
+    static const bool sse = simd_level() != SimdLevel::Scalar;
+    if (sse) {
+        switch (bytes_per_pixel) {
+        case 1:
+            return unfilter_sse<1>(filter_type, row, previous, length);
+        case 2:
+            return unfilter_sse<2>(filter_type, row, previous, length);
+        case 3:
+            return unfilter_sse<3>(filter_type, row, previous, length);
+        case 4:
+            return unfilter_sse<4>(filter_type, row, previous, length);
+        case 6:
+            return unfilter_sse<6>(filter_type, row, previous, length);
+        case 8:
+            return unfilter_sse<8>(filter_type, row, previous, length);
+        default:
+            break;
+        }
+    }
+#endif
+    switch (bytes_per_pixel) {
+    case 1:
+        return unfilter_scalar<1>(filter_type, row, previous, length);
+    case 2:
+        return unfilter_scalar<2>(filter_type, row, previous, length);
+    case 3:
+        return unfilter_scalar<3>(filter_type, row, previous, length);
+    case 4:
+        return unfilter_scalar<4>(filter_type, row, previous, length);
+    case 6:
+        return unfilter_scalar<6>(filter_type, row, previous, length);
+    case 8:
+        return unfilter_scalar<8>(filter_type, row, previous, length);
+    default:
+        return unfilter_scalar_body(filter_type, row, previous, length, bytes_per_pixel);
+    }
+}
+
+SIMD_INLINE uint8_t paeth_branchless(const uint8_t a, const uint8_t b, const uint8_t c)
+{
+    const int32_t pa = std::abs(b - c);
+    const int32_t pb = std::abs(a - c);
+    const int32_t pc = std::abs(a + b - 2 * c);
+    const uint8_t bc = pb <= pc ? b : c;
+    return pa <= pb && pa <= pc ? a : bc;
+}
+
+SIMD_INLINE void filter_row_body(const uint8_t filter_type, const uint8_t* row, const uint8_t* previous,
+    const size_t length, const size_t bpp, uint8_t* out)
+{
+    const size_t first = std::min(bpp, length);
+    switch (filter_type) {
+    case 1:
+        std::copy_n(row, first, out);
+        for (size_t i = first; i < length; ++i)
+            out[i] = static_cast<uint8_t>(row[i] - row[i - bpp]);
+        break;
+    case 2:
+        for (size_t i = 0; i < length; ++i)
+            out[i] = static_cast<uint8_t>(row[i] - previous[i]);
+        break;
+    case 3:
+        for (size_t i = 0; i < first; ++i)
+            out[i] = static_cast<uint8_t>(row[i] - (previous[i] >> 1));
+        for (size_t i = first; i < length; ++i)
+            out[i] = static_cast<uint8_t>(row[i] - ((row[i - bpp] + previous[i]) >> 1));
+        break;
+    case 4:
+        for (size_t i = 0; i < first; ++i)
+            out[i] = static_cast<uint8_t>(row[i] - previous[i]);
+        for (size_t i = first; i < length; ++i)
+            out[i] = static_cast<uint8_t>(row[i] - paeth_branchless(row[i - bpp], previous[i], previous[i - bpp]));
+        break;
+    default:
+        std::copy_n(row, length, out);
+        break;
+    }
+}
+
+SIMD_DISPATCH(void, filter_row_dispatch, filter_row_body, (const uint8_t filter_type, const uint8_t* row,
+    const uint8_t* previous, const size_t length, const size_t bpp, uint8_t* out),
+    (filter_type, row, previous, length, bpp, out))
+
+void filter_row(const uint8_t filter_type, const uint8_t* row, const uint8_t* previous, const size_t length,
+    const size_t bytes_per_pixel, uint8_t* out)
+{
+    if (4 < filter_type)
+        throw std::exception();
+    filter_row_dispatch(filter_type, row, previous, length, bytes_per_pixel, out);
+}
+
+static void add_filter_costs(const uint8_t* row, const uint8_t* previous, const size_t begin, const size_t end,
+    const size_t bpp, uint64_t* costs)
+{
+    const auto cost = [](const int32_t residual) {
+        return static_cast<uint64_t>(std::abs(static_cast<int8_t>(residual)));
+    };
+    for (size_t i = begin; i < end; ++i) {
+        const uint8_t a = i < bpp ? 0 : row[i - bpp];
+        const uint8_t b = previous[i];
+        const uint8_t c = i < bpp ? 0 : previous[i - bpp];
+        costs[0] += cost(row[i]);
+        costs[1] += cost(row[i] - a);
+        costs[2] += cost(row[i] - b);
+        costs[3] += cost(row[i] - ((a + b) >> 1));
+        costs[4] += cost(row[i] - paeth_predictor(a, b, c));
+    }
+}
+
+#ifdef UNFILTER_SSE
+// Filtering forward has no dependency between pixels, so 16 bytes of every filter are computed at once; psadbw
+// sums the absolute residuals.
+SIMD_TARGET_SSE41 static size_t add_filter_costs_sse(const uint8_t* row, const uint8_t* previous, const size_t length,
+    const size_t bpp, uint64_t* costs)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i low_bit = _mm_set1_epi8(1);
+    __m128i sums[5] = { zero, zero, zero, zero, zero };
+    size_t i = bpp;
+    for (; i + 16 <= length; i += 16) {
+        const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i - bpp));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(previous + i));
+        const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(previous + i - bpp));
+        const __m128i average = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), low_bit));
+        const __m128i paeth = _mm_packus_epi16(
+            paeth_predict_sse(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(c, zero)),
+            paeth_predict_sse(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(c, zero)));
+        const __m128i residuals[5] = { x, _mm_sub_epi8(x, a), _mm_sub_epi8(x, b), _mm_sub_epi8(x, average),
+            _mm_sub_epi8(x, paeth) };
+        for (int32_t filter = 0; filter < 5; ++filter)
+            sums[filter] = _mm_add_epi64(sums[filter], _mm_sad_epu8(_mm_abs_epi8(residuals[filter]), zero));
+    }
+    for (int32_t filter = 0; filter < 5; ++filter) {
+        uint64_t sum;
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(&sum),
+            _mm_add_epi64(sums[filter], _mm_srli_si128(sums[filter], 8)));
+        costs[filter] += sum;
+    }
+    return i;
+}
+#endif
+
+uint8_t choose_filter(const uint8_t* row, const uint8_t* previous, const size_t length, const size_t bytes_per_pixel,
+    const uint8_t filter_count)
+{
+    assert(1 <= filter_count && filter_count <= 5 && "out of range filter_count");
+    uint64_t costs[5] = {};
+    const size_t first = std::min(bytes_per_pixel, length);
+    add_filter_costs(row, previous, 0, first, bytes_per_pixel, costs);
+    size_t done = first;
+#ifdef UNFILTER_SSE
+    static const bool sse = simd_level() != SimdLevel::Scalar;
+    if (sse)
+        done = add_filter_costs_sse(row, previous, length, bytes_per_pixel, costs);
+#endif
+    add_filter_costs(row, previous, done, length, bytes_per_pixel, costs);
+    return static_cast<uint8_t>(std::min_element(costs, costs + filter_count) - costs);
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#ifndef UNFILTER_H
+#define UNFILTER_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Undoes the PNG filter (0 None, 1 Sub, 2 Up, 3 Average, 4 Paeth) of one scanline in place. `previous` is the
+// unfiltered scanline above, all zero for the first one. Throws std::exception for an unknown filter type.
+void unfilter_row(uint8_t filter_type, uint8_t* row, const uint8_t* previous, size_t length, size_t bytes_per_pixel);
+// Filters one scanline with `filter_type` into `out`, `length` bytes without the filter type byte.
+void filter_row(uint8_t filter_type, const uint8_t* row, const uint8_t* previous, size_t length,
+    size_t bytes_per_pixel, uint8_t* out);
+// The filter type whose output has the smallest sum of absolute values, bytes taken as signed: the usual stand-in
+// for what deflates best. All five filters are measured in one pass over the scanline; the pick is among the first
+// `filter_count` types.
+uint8_t choose_filter(const uint8_t* row, const uint8_t* previous, size_t length, size_t bytes_per_pixel,
+    uint8_t filter_count = 5);
+// The Paeth predictor as the PNG specification defines it: whichever of a (left), b (up) and c (upper left) is
+// closest to a + b - c, preferring a, then b.
+uint8_t paeth_predictor(uint8_t a, uint8_t b, uint8_t c);
+
+#endif //UNFILTER_H
@@ -0,0 +1,117 @@
+#include "unsharp.h"
+
+#include "cpu_dispatch.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+static std::vector<float> make_gauss_kernel_1d(const double std_deviation)
+{
+    const int32_t distance = std::max(1, static_cast<int32_t>(std::ceil(3.0 * std_deviation)));
+    std::vector<float> result(distance * 2 + 1);
+    double sum = 0;
+    for (int32_t x = -distance; x <= distance; ++x)
+        sum += std::exp(-(x * x) / (2.0 * std_deviation * std_deviation));
+    for (int32_t x = -distance; x <= distance; ++x)
+        result[x + distance] = static_cast<float>(std::exp(-(x * x) / (2.0 * std_deviation * std_deviation)) / sum);
+    return result;
+}
+
+SIMD_INLINE void blur_row_horizontal(const uint8_t* src, float* dst, std::vector<float>& padded, const int32_t width,
+    const int32_t channels, const std::vector<float>& kernel)
+{
+    const int32_t distance = static_cast<int32_t>(kernel.size()) / 2;
+    const size_t length = static_cast<size_t>(width) * channels;
+    for (int32_t col = 0; col < distance; ++col)
+        for (int32_t channel = 0; channel < channels; ++channel) {
+            padded[col * channels + channel] = src[channel];
+            padded[(width + distance + col) * channels + channel] = src[length - channels + channel];
+        }
+    float* middle = padded.data() + distance * channels;
+    for (size_t i = 0; i < length; ++i)
+        middle[i] = src[i];
+    std::fill(dst, dst + length, 0.0f);
+    for (size_t tap = 0; tap < kernel.size(); ++tap) {
+        const float weight = kernel[tap];
+        const float* shifted = padded.data() + tap * channels;
+        for (size_t i = 0; i < length; ++i)
+            dst[i] += weight * shifted[i];
+    }
+}
+
+SIMD_INLINE void unsharp_band_body(uint8_t* pixels, const int32_t begin, const int32_t end, const int32_t width,
+    const int32_t channels, const std::vector<float>& kernel, const std::vector<uint8_t>& halo, const float amount,
+    const float threshold)
+{
+    const int32_t distance = static_cast<int32_t>(kernel.size()) / 2;
+    const int32_t diameter = distance * 2 + 1;
+    const size_t length = static_cast<size_t>(width) * channels;
+    std::vector<float> ring(diameter * length);
+    std::vector<float> padded((width + 2 * distance) * channels);
+    std::vector<float> blurred(length);
+    auto source_row = [&](const int32_t row) -> const uint8_t* {
+        if (row < begin)
+            return halo.data() + (row - begin + distance) * length;
+        if (end <= row)
+            return halo.data() + (row - end + distance) * length;
+        return pixels + row * length;
+    };
+    auto slot = [diameter](const int32_t row) { return ((row % diameter) + diameter) % diameter; };
+    for (int32_t row = begin - distance; row < begin + distance; ++row)
+        blur_row_horizontal(source_row(row), &ring[slot(row) * length], padded, width, channels, kernel);
+    for (int32_t row = begin; row < end; ++row) {
+        blur_row_horizontal(source_row(row + distance), &ring[slot(row + distance) * length], padded, width,
+            channels, kernel);
+        std::fill(blurred.begin(), blurred.end(), 0.0f);
+        for (int32_t tap = 0; tap < diameter; ++tap) {
+            const float weight = kernel[tap];
+            const float* blurred_row = &ring[slot(row - distance + tap) * length];
+            for (size_t i = 0; i < length; ++i)
+                blurred[i] += weight * blurred_row[i];
+        }
+        uint8_t* dst = pixels + row * length;
+        for (size_t i = 0; i < length; ++i) {
+            const float original = dst[i];
+            const float difference = original - blurred[i];
+            const float sharpened = std::clamp(original + amount * difference + 0.5f, 0.0f, 255.0f);
+            dst[i] = static_cast<uint8_t>(std::abs(difference) < threshold ? original : sharpened);
+        }
+    }
+}
+
+SIMD_DISPATCH(void, unsharp_band, unsharp_band_body, (uint8_t* pixels, const int32_t begin, const int32_t end,
+    const int32_t width, const int32_t channels, const std::vector<float>& kernel, const std::vector<uint8_t>& halo,
+    const float amount, const float threshold), (pixels, begin, end, width, channels, kernel, halo, amount, threshold))
+
+void unsharp_mask_filter(uint8_t* pixels, const int32_t height, const int32_t width, const int32_t channels,
+    const double radius, const double amount, const int32_t threshold)
+{
+    if (radius <= 0.0 || height == 0 || width == 0)
+        return;
+    const std::vector<float> kernel = make_gauss_kernel_1d(radius);
+    const int32_t distance = static_cast<int32_t>(kernel.size()) / 2;
+    const size_t length = static_cast<size_t>(width) * channels;
+    const int32_t bands = std::clamp(height / std::max(4 * distance, 16), 1, thread_count());
+    // Rows next to a band are overwritten by the neighbouring band, so keep their originals per band:
+    // `distance` rows above followed by `distance` rows below.
+    std::vector<std::vector<uint8_t> > halos(bands);
+    for (int32_t band = 0; band < bands; ++band) {
+        const int32_t begin = height * band / bands;
+        const int32_t end = height * (band + 1) / bands;
+        std::vector<uint8_t>& halo = halos[band];
+        halo.resize(2 * distance * length);
+        for (int32_t i = 0; i < distance; ++i) {
+            const uint8_t* above = pixels + std::clamp(begin - distance + i, 0, height - 1) * length;
+            const uint8_t* below = pixels + std::clamp(end + i, 0, height - 1) * length;
+            std::copy_n(above, length, halo.data() + i * length);
+            std::copy_n(below, length, halo.data() + (distance + i) * length);
+        }
+    }
+    parallel_bands(bands, [&](const int32_t first, const int32_t last) {
+        for (int32_t band = first; band < last; ++band)
+            unsharp_band(pixels, height * band / bands, height * (band + 1) / bands, width, channels, kernel,
+                halos[band], static_cast<float>(amount), static_cast<float>(threshold));
+    }, 1);
+}
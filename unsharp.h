@@ -0,0 +1,14 @@
+#pragma once
+
+#ifndef UNSHARP_H
+#define UNSHARP_H
+
+#include <cstdint>
+
+// In place unsharp mask: out = in + amount * (in - gaussian(in)) wherever |in - gaussian(in)| >= threshold.
+// The blur is separable and streamed through a ring of horizontally blurred rows, so the blurred image never
+// exists as a whole.
+void unsharp_mask_filter(uint8_t* pixels, int32_t height, int32_t width, int32_t channels, double radius,
+    double amount, int32_t threshold);
+
+#endif //UNSHARP_H